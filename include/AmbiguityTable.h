@@ -0,0 +1,18 @@
+#pragma once
+
+// edge index used by resolved cases for a vertex placed at the centre of the cube rather than on one of its edges
+const int CUBE_CENTER = 12;
+extern float cubeCenter[3];
+
+// corners of the 6 cube faces, counter-clockwise when seen from outside the cube
+extern int faceCorners[6][4];
+
+// asymptotic decider: bit f is set when face f is ambiguous and the bilinear saddle of the face lies inside
+// the surface, meaning the two inside corners of the face are connected
+int ambiguous_face_bits(const float scalars[8], float isoValue);
+
+// triangle edges (indices for vertTable or CUBE_CENTER, -1 terminated) for a cube, with its ambiguous faces resolved by
+// the asymptotic decider and its inside by a body test, so the surface has the topology of the trilinear interpolant:
+// neighbouring cubes always agree on a shared face so there are no cracks, and two sheets are joined by a tube
+// wherever the interpolant connects them through the inside of the cube
+const signed char* resolved_case(int theCase, const float scalars[8], float isoValue);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// queue with a fixed capacity for exactly one producer thread and one consumer thread
+// push waits while the queue is full and pop waits while it is empty, so a slow consumer throttles the producer
+// and at most capacity items are ever held
+// items pass through a lock-free ring, a waiting side spins briefly and then sleeps on a condition variable so an
+// idle stage does not keep a core busy
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0), producerWaiting(false), consumerWaiting(false) {}
+
+	// called by the producer only
+	void push(T&& item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t next = (t + 1) % slots.size();
+		// the slot after tail is head while the queue is full
+		wait_until(producerWaiting, [&]() { return next != head.load(); });
+		slots[t] = std::move(item);
+		tail.store(next);
+		wake(consumerWaiting);
+	}
+
+	// called by the consumer only
+	T pop() {
+		size_t h = head.load(std::memory_order_relaxed);
+		wait_until(consumerWaiting, [&]() { return h != tail.load(); });
+		T item = std::move(slots[h]);
+		head.store((h + 1) % slots.size());
+		wake(producerWaiting);
+		return item;
+	}
+
+private:
+	// spin for a while in case the other side is about to catch up, then sleep until it calls wake
+	template <typename Ready>
+	void wait_until(std::atomic<bool>& waiting, Ready ready) {
+		for (int spin = 0; spin < 64; spin++) {
+			if (ready()) {
+				return;
+			}
+			std::this_thread::yield();
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		// waiting is set before ready is checked and the other side reads it after moving its index (both
+		// sequentially consistent), so either this check sees the move or the other side sees waiting
+		waiting.store(true);
+		changed.wait(lock, ready);
+		waiting.store(false);
+	}
+
+	// wake the other side if it went to sleep
+	void wake(std::atomic<bool>& waiting) {
+		if (waiting.load()) {
+			// taking the lock makes sure the sleeper is inside wait before it is notified
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+			}
+			changed.notify_all();
+		}
+	}
+
+	// one slot is always left free to tell a full queue from an empty one
+	std::vector<T> slots;
+	// next slot to pop, written by the consumer
+	alignas(64) std::atomic<size_t> head;
+	// next slot to push, written by the producer
+	alignas(64) std::atomic<size_t> tail;
+	// set while the producer or the consumer sleeps on changed
+	std::atomic<bool> producerWaiting;
+	std::atomic<bool> consumerWaiting;
+	std::mutex mutex;
+	std::condition_variable changed;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "ScalarGrid.h"
+
+// a block of cells and the range its triangles occupy in ChunkedMesh::vertices
+struct MeshChunk {
+	// first cell of the chunk along x, y and z
+	int cellBegin[3];
+	// one past the last cell of the chunk
+	int cellEnd[3];
+	// bounding box of the chunk's cells, every triangle of the chunk lies inside it
+	float boundsMin[3];
+	float boundsMax[3];
+	// first vertex and number of vertices of the chunk
+	size_t first;
+	size_t count;
+};
+
+// marching cubes output grouped by spatial chunk, each chunk's triangles are contiguous
+struct ChunkedMesh {
+	// x, y, z of every triangle vertex, chunk after chunk
+	std::vector<float> vertices;
+	// every chunk of the grid, including those without triangles
+	std::vector<MeshChunk> chunks;
+};
+
+// split the cells of a sampled lattice into chunks of chunkCells^3 cells, laid out x-major
+std::vector<MeshChunk> chunk_layout(const ScalarGrid& grid, int chunkCells);
+
+// lay out the triangles of every chunk back to back in chunked.vertices, setting each chunk's first and count
+void place_chunks(const std::vector<std::vector<float>>& chunkVertices, ChunkedMesh& chunked);
+
+// marching cubes over a sampled lattice split into chunks of chunkCells^3 cells, the chunks are extracted in parallel
+ChunkedMesh marching_cubes_chunked(const ScalarGrid& grid, float isoValue, int chunkCells = 32, bool resolveAmbiguity = false);
+
+// re-extract the triangles of a single chunk, e.g. after the samples it covers have changed
+std::vector<float> marching_cubes_chunk(const ScalarGrid& grid, float isoValue, const MeshChunk& chunk, bool resolveAmbiguity = false);
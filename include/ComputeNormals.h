@@ -2,4 +2,18 @@
 
 #include <vector>
 
+#include "Mesh.h"
+
 std::vector<float> compute_normals(const std::vector<float>& vertices);
+
+// how the faces around a vertex are weighted in compute_vertex_normals
+enum NormalWeighting {
+	// by the angle of the face at the vertex, independent of how the faces are split into triangles
+	ANGLE_WEIGHTED,
+	// by the area of the face, cheaper and favours large faces
+	AREA_WEIGHTED,
+};
+
+// smooth normals for an indexed mesh, one unit normal per vertex (x, y, z) averaging the faces around it
+// faces are wound as in compute_normals, vertices without faces get a zero normal
+std::vector<float> compute_vertex_normals(const Mesh& mesh, NormalWeighting weighting = ANGLE_WEIGHTED);
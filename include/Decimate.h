@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Mesh.h"
+
+// what a decimation pass did
+struct DecimationStats {
+	size_t trianglesBefore;
+	size_t trianglesAfter;
+	// trianglesAfter / trianglesBefore
+	float reductionRatio;
+	// wall clock time of the whole pass
+	double seconds;
+};
+
+// simplify an indexed mesh with quadric error edge collapses, stopping once it has at most targetTriangles triangles
+// or the cheapest remaining collapse would move the surface by more than maxError, measured as the area weighted mean
+// squared distance of the new vertex to the planes of the original faces around the edge (so in units of length^2,
+// independent of how finely the mesh is tessellated)
+// vertices on open borders of the mesh are kept in place
+// the quadrics and the first plan of every edge are computed in parallel, the collapses then run cheapest first on
+// the calling thread
+Mesh decimate_mesh(const Mesh& mesh, size_t targetTriangles, float maxError, DecimationStats& stats);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// operations of the field bytecode, each one works on whole rows of samples
+enum FieldOp : unsigned char {
+	OP_ADD,
+	OP_SUB,
+	OP_MUL,
+	OP_DIV,
+	OP_NEG,
+	OP_MIN,
+	OP_MAX,
+	OP_POW,
+	OP_SIN,
+	OP_COS,
+	OP_TAN,
+	OP_EXP,
+	OP_LOG,
+	OP_SQRT,
+	OP_ABS,
+};
+
+// one bytecode instruction, dst = op(a, b) over registers (b is unused by unary operations)
+struct FieldInstruction {
+	FieldOp op;
+	unsigned short dst, a, b;
+};
+
+// scalar field f(x, y, z) compiled from an expression string
+// registers 0, 1 and 2 hold x, y and z, the next constants.size() registers hold the constants, the rest are temporaries
+struct CompiledField {
+	std::string source;
+	std::vector<FieldInstruction> program;
+	std::vector<float> constants;
+	int registerCount;
+	int resultRegister;
+};
+
+// parse an expression in x, y and z, e.g. "y - sin(x) * cos(z)", folding constants and sharing repeated
+// subexpressions, then compile it to register bytecode
+// supports + - * / ^, parentheses, pi, e, sin cos tan exp log sqrt abs (one argument) and min max pow (two arguments)
+// returns false and describes the problem in error if the expression is invalid
+bool compile_field(const std::string& expression, CompiledField& field, std::string& error);
+
+// evaluate the field at count points given as separate x, y and z arrays
+void evaluate_field_row(const CompiledField& field, const float* x, const float* y, const float* z, float* out, size_t count);
+
+// evaluate the field at a single point
+float evaluate_field(const CompiledField& field, float x, float y, float z);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+#include "ScalarGrid.h"
+#include "FieldExpression.h"
+
+// one grid stored in the cache
+struct GridCacheEntry {
+	uint64_t key;
+	size_t bytes;
+	// larger is more recent
+	uint64_t lastUse;
+};
+
+// sampled grids kept on disk between runs, keyed by field identity, min, max and step size
+// each grid is a checksummed, memory-mappable file in directory, the least recently used are evicted to stay under
+// maxBytes
+struct GridCache {
+	std::string directory;
+	size_t maxBytes;
+	std::vector<GridCacheEntry> entries;
+	uint64_t useCounter;
+	// lookups answered from disk and lookups that had to sample
+	size_t hits;
+	size_t misses;
+	// grids removed to make room
+	size_t evictions;
+	// files that failed the integrity checks, they are counted as misses too
+	size_t corrupt;
+};
+
+// open (creating it if needed) the cache in directory, reading its index of entries
+GridCache open_grid_cache(const std::string& directory, size_t maxBytes);
+
+// sample f on the lattice covering the cube [min, max]^3, or map the grid sampled by an earlier run
+// a mapped grid borrows its samples from the file (see GridValues) until something writes to them
+// fieldKey must identify f, e.g. its name and a build stamp, grids are only shared between identical keys
+ScalarGrid cached_sample_grid(
+	GridCache& cache,
+	const std::string& fieldKey,
+	std::function<float(float, float, float)> f,
+	float min,
+	float max,
+	float stepSize);
+
+// same as above for a compiled field, keyed by its expression
+ScalarGrid cached_sample_grid(
+	GridCache& cache,
+	const CompiledField& field,
+	float min,
+	float max,
+	float stepSize);
+
+// total size of the grids in the cache
+size_t grid_cache_bytes(const GridCache& cache);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "ScalarGrid.h"
+
+// marching cubes meshes of one sampled grid at several resolutions, stored back to back in a single vertex list
+struct LodMesh {
+	// x, y, z of every triangle vertex, the finest level first
+	std::vector<float> vertices;
+	// first vertex of each level, followed by the total vertex count, so level l spans [levelOffsets[l], levelOffsets[l + 1])
+	std::vector<size_t> levelOffsets;
+	// lattice step used by each level
+	std::vector<float> levelStepSizes;
+};
+
+// build levels at 1, 2, 4, ... times the grid's step by subsampling the grid, the field is not evaluated again,
+// level 0 is always present even when the grid is too small to hold a cell
+LodMesh marching_cubes_lod(const ScalarGrid& grid, float isoValue, int levels = 4, bool resolveAmbiguity = false);
+
+// level to draw for a camera at the given distance, the finest level is used up to fullDetailDistance and each
+// doubling of the distance after that moves one level coarser
+int select_lod_level(const LodMesh& lod, float distance, float fullDetailDistance);
@@ -3,12 +3,65 @@
 #include <vector>
 #include <functional>
 #include <cmath>
+#include <cstdint>
 
 #include "TriTable.h"
+#include "ScalarGrid.h"
+#include "Mesh.h"
 
 std::vector<float> marching_cubes(
 	std::function<float(float, float, float)> f,
 	float isoValue,
 	float min,
 	float max,
-	float stepSize);
+	float stepSize,
+	bool resolveAmbiguity = false);
+
+// marching cubes over a field compiled from an expression
+std::vector<float> marching_cubes(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	bool resolveAmbiguity = false);
+
+// marching cubes over a lattice that has already been sampled, with resolveAmbiguity set the asymptotic decider picks
+// the triangulation of ambiguous faces and a body test the one of ambiguous cube interiors, so the mesh comes out
+// watertight with the topology of the trilinear interpolant
+std::vector<float> marching_cubes(const ScalarGrid& grid, float isoValue, bool resolveAmbiguity = false);
+
+// march the box of cells [cellBegin, cellEnd) of a sampled lattice, appending the triangle vertices to verticesList
+void marching_cubes_cells(
+	const ScalarGrid& grid,
+	float isoValue,
+	const int cellBegin[3],
+	const int cellEnd[3],
+	bool resolveAmbiguity,
+	std::vector<float>& verticesList);
+
+// marching cubes producing an indexed mesh, vertices shared by neighbouring cubes are welded by their lattice edge
+Mesh marching_cubes_indexed(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	bool resolveAmbiguity = false);
+
+// marching cubes over a lattice that has already been sampled, producing an indexed mesh
+Mesh marching_cubes_indexed(const ScalarGrid& grid, float isoValue, bool resolveAmbiguity = false);
+
+// marching cubes producing an indexed mesh along with the lattice id of every vertex (see lattice_edge_id), sorted
+// ascending, so meshes of neighbouring grids of one lattice can be welded exactly along their shared planes
+Mesh marching_cubes_indexed(const ScalarGrid& grid, float isoValue, bool resolveAmbiguity, std::vector<uint64_t>& vertexIds);
+
+// bits per coordinate in a lattice id, enough for lattices of up to a million samples along each axis
+const int LATTICE_ID_BITS = 20;
+
+// id of the lattice edge starting at lattice point (i, j, k) along axis (0, 1 or 2), or of the centre of the cube whose
+// lowest corner is (i, j, k) for axis 3
+uint64_t lattice_edge_id(int i, int j, int k, int axis);
+
+// lattice point of an id from lattice_edge_id, returns the axis
+int lattice_edge_point(uint64_t id, int point[3]);
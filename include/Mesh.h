@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+// indexed triangle mesh
+struct Mesh {
+	// x, y, z coordinates of every vertex
+	std::vector<float> vertices;
+	// 3 consecutive vertex indices make up a triangle
+	std::vector<unsigned int> indices;
+};
+
+// expand an indexed mesh into the unindexed triangle list used by compute_normals, writePLY and drawMarch
+std::vector<float> mesh_to_soup(const Mesh& mesh);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <functional>
+
+// number of worker threads used by parallel_for
+int worker_count();
+
+// limit parallel_for to the given number of workers, 0 goes back to one per hardware thread
+// meant to be set once at startup, e.g. by a worker process sharing the machine with others
+void set_worker_count(int workers);
+
+// split [begin, end) into one contiguous range per worker and run body(rangeBegin, rangeEnd, worker) on each concurrently
+void parallel_for(int begin, int end, const std::function<void(int, int, int)>& body);
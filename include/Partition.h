@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "FieldExpression.h"
+#include "Mesh.h"
+
+// box of cells [cellBegin, cellEnd) of the lattice covering the cube [min, max]^3
+// neighbouring boxes share the lattice plane between them, so each one samples that plane itself
+struct PartitionBox {
+	int cellBegin[3];
+	int cellEnd[3];
+};
+
+// mesh of one partition, with the lattice id of every vertex (sorted ascending) for welding
+struct PartialMesh {
+	Mesh mesh;
+	std::vector<uint64_t> vertexIds;
+};
+
+// split the cells of the lattice covering [min, max]^3 into partitionsPerAxis^3 boxes of (almost) equal size
+std::vector<PartitionBox> partition_domain(float min, float max, float stepSize, int partitionsPerAxis);
+
+// sample and extract one box in this process
+PartialMesh extract_partition(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float stepSize,
+	const PartitionBox& box,
+	bool resolveAmbiguity);
+
+// weld partial meshes into one, vertices on shared planes have the same lattice id in both partitions and are merged
+Mesh merge_partitions(const std::vector<PartialMesh>& parts);
+
+// worker side of marching_cubes_partitioned: read a job file, extract its box and write the partial mesh it names
+// returns false (with the problem printed to std::cerr) if the job could not be completed
+bool run_partition_job(const std::string& jobFile);
+
+// extract a compiled field with each partition in its own worker process, then merge the partial meshes
+// workers are started directly (no shell) as `workerExecutable --partition-worker <job file>`, at most maxProcesses
+// at a time with the machine's threads split between them, and exchange data with the coordinator only through
+// files starting with workPrefix followed by the process id and a run counter, so concurrent runs do not collide
+// the files are removed afterwards, whether the run succeeded or not
+// the result is the same mesh as marching_cubes_indexed up to the order of the triangles
+// returns false and describes the problem in error if a worker failed
+bool marching_cubes_partitioned(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int partitionsPerAxis,
+	int maxProcesses,
+	const std::string& workerExecutable,
+	const std::string& workPrefix,
+	bool resolveAmbiguity,
+	Mesh& mesh,
+	std::string& error);
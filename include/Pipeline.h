@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstddef>
+
+#include "FieldExpression.h"
+
+// timings of a pipelined run, the busy times leave out time spent waiting on the queues
+struct PipelineStats {
+	// wall clock time of the whole run
+	double seconds;
+	// time spent sampling and extracting slabs
+	double extractSeconds;
+	// time spent computing normals
+	double normalSeconds;
+	// time spent writing the file
+	double writeSeconds;
+	size_t slabs;
+	size_t triangles;
+};
+
+// sample, extract, compute normals for and write f as fileName.ply one x slab of slabCells cells at a time
+// extraction, normals and writing run on separate threads connected by queues holding at most queueDepth slabs,
+// so the run takes about as long as the slowest stage and only a few slabs are in memory at once
+// the header is written first with the element counts padded to a fixed width and patched in place at the end, apart
+// from that padding the file is identical to marching_cubes followed by compute_normals and writePLY
+PipelineStats write_ply_pipelined(
+	std::function<float(float, float, float)> f,
+	float isoVal,
+	float min,
+	float max,
+	float stepSize,
+	std::string fileName,
+	int slabCells = 16,
+	int queueDepth = 4,
+	bool resolveAmbiguity = false);
+
+// same as above for a compiled field
+PipelineStats write_ply_pipelined(
+	const CompiledField& field,
+	float isoVal,
+	float min,
+	float max,
+	float stepSize,
+	std::string fileName,
+	int slabCells = 16,
+	int queueDepth = 4,
+	bool resolveAmbiguity = false);
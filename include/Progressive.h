@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+#include "FieldExpression.h"
+
+// the mesh delivered by one pass of a progressive extraction
+struct ProgressivePass {
+	// 0 for the coarsest pass
+	int pass;
+	// lattice step of this pass, the final pass uses the requested step size
+	float stepSize;
+	// x, y, z of every triangle vertex, as returned by marching_cubes
+	std::vector<float> vertices;
+	// seconds since the extraction started
+	double seconds;
+	bool final;
+};
+
+// what a progressive extraction did
+struct ProgressiveStats {
+	// passes delivered to the callback
+	int passes;
+	// seconds until the first (coarsest) mesh was ready
+	double timeToFirstMesh;
+	// seconds until the last delivered pass was ready
+	double seconds;
+	// true if the callback stopped the extraction before the final pass
+	bool cancelled;
+	// field evaluations over all passes, the same as a single fine sampling
+	size_t samplesEvaluated;
+};
+
+// marching cubes at coarseFactor times the step first (rounded down to a power of two), then at half the step of the
+// previous pass until the requested step is reached, calling onPass with each mesh
+// every pass samples only the lattice points the previous passes did not have, so the final mesh costs no more
+// samples than marching_cubes and is identical to it
+// onPass returns false to stop before the next pass
+ProgressiveStats marching_cubes_progressive(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	const std::function<bool(const ProgressivePass&)>& onPass,
+	int coarseFactor = 8,
+	bool resolveAmbiguity = false);
+
+// same as above for a compiled field
+ProgressiveStats marching_cubes_progressive(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	const std::function<bool(const ProgressivePass&)>& onPass,
+	int coarseFactor = 8,
+	bool resolveAmbiguity = false);
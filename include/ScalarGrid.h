@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <memory>
+#include <cstddef>
+
+#include "FieldExpression.h"
+
+// samples of a grid, either owned or borrowed from read-only memory (e.g. a mapped file) that owner keeps alive for
+// as long as any grid uses it
+// reading through a const grid never copies, anything that may write (non-const [] and data(), resize) first copies
+// borrowed samples into owned storage, so only read borrowed grids through const references from several threads
+class GridValues {
+public:
+	GridValues() : borrowed(nullptr), borrowedCount(0) {}
+
+	// use count samples at data without copying them
+	void borrow(const float* data, size_t count, std::shared_ptr<const void> owner) {
+		values.clear();
+		values.shrink_to_fit();
+		borrowed = data;
+		borrowedCount = count;
+		borrowedOwner = std::move(owner);
+	}
+
+	bool is_borrowed() const { return borrowed != nullptr; }
+	size_t size() const { return borrowed ? borrowedCount : values.size(); }
+	bool empty() const { return size() == 0; }
+	const float* data() const { return borrowed ? borrowed : values.data(); }
+	const float& operator[](size_t i) const { return data()[i]; }
+
+	float* data() { own(); return values.data(); }
+	float& operator[](size_t i) { own(); return values[i]; }
+	void resize(size_t count) { own(); values.resize(count); }
+
+private:
+	// copy borrowed samples into values
+	void own() {
+		if (borrowed) {
+			values.assign(borrowed, borrowed + borrowedCount);
+			borrowed = nullptr;
+			borrowedCount = 0;
+			borrowedOwner.reset();
+		}
+	}
+
+	std::vector<float> values;
+	const float* borrowed;
+	size_t borrowedCount;
+	std::shared_ptr<const void> borrowedOwner;
+};
+
+// scalar field sampled once on a regular lattice, shared by all extraction engines
+struct ScalarGrid {
+	// number of samples along x, y and z
+	int dims[3];
+	// position of lattice point (0, 0, 0)
+	float origin[3];
+	// lattice index of sample (0, 0, 0), non zero when the grid only holds part of a larger lattice
+	int offset[3];
+	// distance between neighbouring samples
+	float stepSize;
+	// samples stored x-major, see index()
+	GridValues values;
+
+	// position of sample (i, j, k) in the values list
+	size_t index(int i, int j, int k) const {
+		return ((size_t)i * dims[1] + j) * dims[2] + k;
+	}
+
+	// world coordinate along an axis of a (possibly fractional) sample index, computed from the lattice index so
+	// grids holding different parts of the same lattice agree exactly
+	float position(int axis, float sample) const {
+		return origin[axis] + (offset[axis] + sample) * stepSize;
+	}
+};
+
+// number of cells needed to cover [min, max] with the given step size
+int cell_count(float min, float max, float stepSize);
+
+// sample f on the lattice covering the cube [min, max]^3
+ScalarGrid sample_grid(
+	std::function<float(float, float, float)> f,
+	float min,
+	float max,
+	float stepSize);
+
+// sample a compiled field on the lattice covering the cube [min, max]^3, a whole row of z samples per evaluation
+ScalarGrid sample_grid(
+	const CompiledField& field,
+	float min,
+	float max,
+	float stepSize);
+
+// sample only the x planes [firstPlane, lastPlane] of the lattice covering the cube [min, max]^3
+ScalarGrid sample_slab(
+	std::function<float(float, float, float)> f,
+	float min,
+	float max,
+	float stepSize,
+	int firstPlane,
+	int lastPlane);
+
+// sample only the x planes [firstPlane, lastPlane] of the lattice covering the cube [min, max]^3
+ScalarGrid sample_slab(
+	const CompiledField& field,
+	float min,
+	float max,
+	float stepSize,
+	int firstPlane,
+	int lastPlane);
+
+// sample only the samples [sampleBegin, sampleEnd] (inclusive lattice indices) of the lattice starting at (min, min, min)
+ScalarGrid sample_box(
+	std::function<float(float, float, float)> f,
+	float min,
+	float stepSize,
+	const int sampleBegin[3],
+	const int sampleEnd[3]);
+
+// sample only the samples [sampleBegin, sampleEnd] (inclusive lattice indices) of the lattice starting at (min, min, min)
+ScalarGrid sample_box(
+	const CompiledField& field,
+	float min,
+	float stepSize,
+	const int sampleBegin[3],
+	const int sampleEnd[3]);
+
+// keep every factor-th sample of a grid along each axis, the result covers the same origin with factor times the step
+ScalarGrid subsample_grid(const ScalarGrid& grid, int factor);
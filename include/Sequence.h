@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <fstream>
+#include <cstddef>
+
+#include "ScalarGrid.h"
+#include "ChunkedMesh.h"
+
+// what extract_frame did with the bricks of a frame
+struct FrameStats {
+	size_t bricks;
+	// bricks entirely on one side of the isovalue, settled from their min/max alone
+	size_t skippedBricks;
+	// bricks whose samples did not cross the isovalue, their previous triangles were kept
+	size_t reusedBricks;
+	// bricks that had to be marched again
+	size_t extractedBricks;
+};
+
+// state kept between the frames of a time-varying field
+struct SequenceExtractor {
+	float isoValue;
+	int brickCells;
+	bool resolveAmbiguity;
+	// samples of the previous frame, empty before the first frame
+	ScalarGrid previous;
+	// brickCells the previous frame was split with
+	int previousBrickCells;
+	// smallest and largest sample of every brick in the previous frame
+	std::vector<float> brickMin;
+	std::vector<float> brickMax;
+	// triangles of every brick in the previous frame
+	std::vector<std::vector<float>> brickVertices;
+	// 1 for the bricks whose triangles changed in the last call to extract_frame
+	std::vector<unsigned char> brickChanged;
+};
+
+// what write_sequence did
+struct SequenceStats {
+	int frames;
+	// wall clock time of sampling, extracting and writing every frame
+	double seconds;
+	double framesPerSecond;
+	size_t reusedBricks;
+	size_t extractedBricks;
+	// size of the written file
+	size_t bytes;
+};
+
+// start a sequence, bricks are blocks of brickCells^3 cells
+SequenceExtractor make_sequence_extractor(float isoValue, int brickCells = 16, bool resolveAmbiguity = false);
+
+// extract the next frame of a sequence from its samples, a frame on a different lattice (or after brickCells changed)
+// starts the sequence over
+// bricks whose samples kept the same side of the isovalue (the same values when resolving ambiguity) since the last
+// frame reuse their triangles, the result is identical to marching_cubes_chunked with brickCells sized chunks
+ChunkedMesh extract_frame(SequenceExtractor& sequence, ScalarGrid grid, FrameStats& stats);
+
+// sample f(x, y, z, t) at t = 0, timeStep, 2 timeStep, ... over the cube [min, max]^3 and write the frames to fileName
+// each frame only stores the bricks that changed, with vertices as 16 bit half step lattice coordinates, so lattices
+// can have at most 32767 cells along each axis, finer lattices are rejected without writing anything
+SequenceStats write_sequence(
+	std::function<float(float, float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int frames,
+	float timeStep,
+	std::string fileName,
+	int brickCells = 16,
+	bool resolveAmbiguity = false);
+
+// read a file written by write_sequence, calling onFrame with the triangle vertices of every frame in turn
+// returns false if the file is missing or invalid
+bool read_sequence(const std::string& fileName, const std::function<void(int, const std::vector<float>&)>& onFrame);
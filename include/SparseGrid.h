@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+#include "FieldExpression.h"
+
+// samples along each side of a leaf block
+const int LEAF_SIZE = 8;
+const int LEAF_SAMPLES = LEAF_SIZE * LEAF_SIZE * LEAF_SIZE;
+
+// one entry of the block table, every LEAF_SIZE^3 block of samples has one
+struct SparseBlock {
+	// index into SparseGrid::leaves, or -1 if the block is a tile
+	int leaf;
+	// value standing in for every sample of a tile, all of them are on the same side of the isovalue as it
+	float tile;
+};
+
+// the samples of an active block, x-major like ScalarGrid
+struct SparseLeaf {
+	// index of the block in SparseGrid::blocks
+	int block;
+	float values[LEAF_SAMPLES];
+};
+
+// sampled field that only stores blocks near the isosurface, the other blocks are single tile values
+struct SparseGrid {
+	// number of samples along x, y and z, as for the dense lattice covering the same cube
+	int dims[3];
+	float origin[3];
+	float stepSize;
+	// the isovalue the grid was activated for
+	float isoValue;
+	// number of blocks along x, y and z
+	int blockDims[3];
+	// every block, x-major
+	std::vector<SparseBlock> blocks;
+	// active blocks, ordered by block index
+	std::vector<SparseLeaf> leaves;
+
+	// position of block (bi, bj, bk) in the blocks list
+	size_t blockIndex(int bi, int bj, int bk) const {
+		return ((size_t)bi * blockDims[1] + bj) * blockDims[2] + bk;
+	}
+
+	// sample (i, j, k), the tile value if it lies in a tile
+	float value(int i, int j, int k) const {
+		const SparseBlock& block = blocks[blockIndex(i / LEAF_SIZE, j / LEAF_SIZE, k / LEAF_SIZE)];
+		if (block.leaf < 0) {
+			return block.tile;
+		}
+		return leaves[block.leaf].values[((i % LEAF_SIZE) * LEAF_SIZE + j % LEAF_SIZE) * LEAF_SIZE + k % LEAF_SIZE];
+	}
+};
+
+// sample f on the lattice covering the cube [min, max]^3, keeping only the blocks with cells that cross isoValue,
+// plus bandBlocks rings of blocks around them
+// every sample is still evaluated once, but memory grows with the surface area rather than the volume
+SparseGrid sample_sparse_grid(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int bandBlocks = 0);
+
+// sample a compiled field into a sparse grid
+SparseGrid sample_sparse_grid(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int bandBlocks = 0);
+
+// memory held by a sparse grid in bytes
+size_t sparse_grid_bytes(const SparseGrid& grid);
+
+// marching cubes over the active leaves of a sparse grid at the isovalue it was sampled for, tiles have no crossing
+// cells and are never visited
+// gives the same triangles as marching cubes over the dense grid, grouped by leaf
+std::vector<float> marching_cubes_sparse(const SparseGrid& grid, bool resolveAmbiguity = false);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "Mesh.h"
+#include "ScalarGrid.h"
+
+// surface nets extraction, places one vertex per cell crossed by the surface and joins them with quads (2 triangles each)
+Mesh surface_nets(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize);
+
+// surface nets over a lattice that has already been sampled
+Mesh surface_nets(const ScalarGrid& grid, float isoValue);
@@ -3,5 +3,7 @@
 
 extern int marching_cubes_lut[256][16];
 extern float vertTable[12][3];
+extern int cornerTable[8][3];
+extern int edgeCorners[12][2];
 
 #endif 
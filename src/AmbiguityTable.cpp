@@ -0,0 +1,682 @@
+#include "../include/AmbiguityTable.h"
+#include "../include/TriTable.h"
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <cstddef>
+
+// corners of the 6 cube faces, counter-clockwise when seen from outside the cube
+int faceCorners[6][4] = {
+	{0, 1, 2, 3},
+	{4, 7, 6, 5},
+	{0, 4, 5, 1},
+	{1, 5, 6, 2},
+	{2, 6, 7, 3},
+	{3, 7, 4, 0},
+};
+
+// every case has at most 12 cut edges, which make at most 12 triangles when fanned around the cube centre or joined
+// into a tube, plus the -1 terminator
+static const size_t RESOLVED_CASE_SIZE = 37;
+
+// position of the CUBE_CENTER vertex inside the cube
+float cubeCenter[3] = { 0.5f, 0.5f, 0.5f };
+
+// find the cube edge joining two corners
+static int edge_between(int c0, int c1) {
+	for (int e = 0; e < 12; e++) {
+		if ((edgeCorners[e][0] == c0 && edgeCorners[e][1] == c1) || (edgeCorners[e][0] == c1 && edgeCorners[e][1] == c0)) {
+			return e;
+		}
+	}
+	return -1;
+}
+
+// whether cube edge e is a side of face f
+static bool on_face(int e, int f) {
+	for (int k = 0; k < 4; k++) {
+		if (edge_between(faceCorners[f][k], faceCorners[f][(k + 1) % 4]) == e) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// whether two cube edges lie on a common face
+static bool share_face(int e0, int e1) {
+	for (int f = 0; f < 6; f++) {
+		if (on_face(e0, f) && on_face(e1, f)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// whether three cube edges lie on a common face, so a triangle between them would lie in that face
+static bool in_one_face(int e0, int e1, int e2) {
+	for (int f = 0; f < 6; f++) {
+		if (on_face(e0, f) && on_face(e1, f) && on_face(e2, f)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// split a polygon of cut edges into triangles without using any chord that lies in a cube face, returns false if that
+// is not possible
+static bool triangulate(const std::vector<int>& polygon, std::vector<int>& triangles) {
+	size_t n = polygon.size();
+	if (n == 3) {
+		triangles.insert(triangles.end(), polygon.begin(), polygon.end());
+		return true;
+	}
+
+	// the polygon edge (0, 1) belongs to exactly one triangle, try every possible third corner for it
+	for (size_t k = 2; k < n; k++) {
+		bool chordsCrossInside = (k == 2 || !share_face(polygon[1], polygon[k])) && (k == n - 1 || !share_face(polygon[k], polygon[0]));
+		if (!chordsCrossInside) {
+			continue;
+		}
+
+		// the triangle splits the polygon into (1 .. k) and (k .. 0)
+		std::vector<int> first(polygon.begin() + 1, polygon.begin() + k + 1);
+		std::vector<int> second(polygon.begin() + k, polygon.end());
+		second.push_back(polygon[0]);
+
+		std::vector<int> result = { polygon[0], polygon[1], polygon[k] };
+		if ((first.size() < 3 || triangulate(first, result)) && (second.size() < 3 || triangulate(second, result))) {
+			triangles.insert(triangles.end(), result.begin(), result.end());
+			return true;
+		}
+	}
+	return false;
+}
+
+// union-find over the 8 cube corners
+static int find_corner(const int* parent, int c) {
+	while (parent[c] != c) {
+		c = parent[c];
+	}
+	return c;
+}
+
+static void join_corners(int* parent, int c0, int c1) {
+	parent[find_corner(parent, c0)] = find_corner(parent, c1);
+}
+
+// group the corners into the pieces of the cube's surface that lie on one side of the isosurface: corners of an edge
+// that are on the same side, and across each ambiguous face the diagonal that faceBits connects
+static void boundary_components(int theCase, int faceBits, int* parent) {
+	for (int c = 0; c < 8; c++) {
+		parent[c] = c;
+	}
+	for (int e = 0; e < 12; e++) {
+		if (((theCase >> edgeCorners[e][0]) & 1) == ((theCase >> edgeCorners[e][1]) & 1)) {
+			join_corners(parent, edgeCorners[e][0], edgeCorners[e][1]);
+		}
+	}
+	for (int f = 0; f < 6; f++) {
+		bool inside[4];
+		for (int k = 0; k < 4; k++) {
+			inside[k] = (theCase >> faceCorners[f][k]) & 1;
+		}
+		bool ambiguous = inside[0] == inside[2] && inside[1] == inside[3] && inside[0] != inside[1];
+		if (ambiguous) {
+			bool insideConnected = (faceBits >> f) & 1;
+			if (inside[0] == insideConnected) {
+				join_corners(parent, faceCorners[f][0], faceCorners[f][2]);
+			}
+			else {
+				join_corners(parent, faceCorners[f][1], faceCorners[f][3]);
+			}
+		}
+	}
+}
+
+// the closed polygons of cut edges bounding the surface inside the cube for one case and one resolution of its
+// ambiguous faces, each one runs around a piece of the cube's surface inside the isosurface
+static std::vector<std::vector<int>> surface_loops(int theCase, int faceBits) {
+	// next[e] is the cut edge that follows e around the polygon bounding the surface inside the cube
+	int next[12];
+	for (int e = 0; e < 12; e++) {
+		next[e] = -1;
+	}
+
+	for (int f = 0; f < 6; f++) {
+		bool inside[4];
+		int edges[4];
+		for (int k = 0; k < 4; k++) {
+			inside[k] = (theCase >> faceCorners[f][k]) & 1;
+			edges[k] = edge_between(faceCorners[f][k], faceCorners[f][(k + 1) % 4]);
+		}
+
+		// each cut edge is entered going outside -> inside or inside -> outside when walking around the face,
+		// a segment always runs from an entering edge to a leaving edge so both faces of an edge chain together
+		int cuts = 0;
+		for (int k = 0; k < 4; k++) {
+			cuts += inside[k] != inside[(k + 1) % 4];
+		}
+
+		if (cuts == 2) {
+			int entering = -1, leaving = -1;
+			for (int k = 0; k < 4; k++) {
+				if (!inside[k] && inside[(k + 1) % 4]) {
+					entering = edges[k];
+				}
+				if (inside[k] && !inside[(k + 1) % 4]) {
+					leaving = edges[k];
+				}
+			}
+			next[entering] = leaving;
+		}
+		else if (cuts == 4) {
+			// ambiguous face: either cut off each inside corner on its own, or connect the inside corners by cutting
+			// off each outside corner instead
+			bool connected = (faceBits >> f) & 1;
+			for (int k = 0; k < 4; k++) {
+				if (!inside[k] && inside[(k + 1) % 4]) {
+					next[edges[k]] = connected ? edges[(k + 3) % 4] : edges[(k + 1) % 4];
+				}
+			}
+		}
+	}
+
+	std::vector<std::vector<int>> loops;
+	bool visited[12] = { false };
+	for (int start = 0; start < 12; start++) {
+		if (next[start] == -1 || visited[start]) {
+			continue;
+		}
+
+		std::vector<int> loop;
+		for (int e = start; !visited[e]; e = next[e]) {
+			visited[e] = true;
+			loop.push_back(e);
+		}
+		loops.push_back(loop);
+	}
+	return loops;
+}
+
+// close one loop with a patch of triangles
+static void close_loop(const std::vector<int>& loop, std::vector<int>& triangles) {
+	// the polygon is not planar, a chord between two of its vertices on the same cube face would lie in that face and
+	// the cube on the other side could emit the same triangle, so only chords that cross the inside of the cube are used
+	std::vector<int> loopTriangles;
+	if (!triangulate(loop, loopTriangles)) {
+		// polygons winding through the cube like a tunnel have no such triangulation, fan them around an extra
+		// vertex at the centre of the cube instead
+		loopTriangles.clear();
+		for (size_t v = 0; v < loop.size(); v++) {
+			loopTriangles.insert(loopTriangles.end(), { CUBE_CENTER, loop[v], loop[(v + 1) % loop.size()] });
+		}
+	}
+	triangles.insert(triangles.end(), loopTriangles.begin(), loopTriangles.end());
+}
+
+// whether the cube may use a chord between two cut edges on one of its ambiguous faces: such a chord either crosses
+// the face or runs around a corner of its connected diagonal, the cube whose low (x, y or z = 0) face it is may use
+// the crossing chords and the one around the lower corner, the cube on the other side only the one around the upper
+// corner, so two cubes sharing a face never emit the same chord or two that cross
+static bool face_chord_allowed(int e0, int e1) {
+	int f = 0;
+	while (!on_face(e0, f) || !on_face(e1, f)) {
+		f++;
+	}
+
+	// the axis the face is perpendicular to
+	int axis = 0;
+	while (cornerTable[faceCorners[f][0]][axis] != cornerTable[faceCorners[f][1]][axis] ||
+		cornerTable[faceCorners[f][0]][axis] != cornerTable[faceCorners[f][2]][axis]) {
+		axis++;
+	}
+	bool lowFace = cornerTable[faceCorners[f][0]][axis] == 0;
+
+	int k = 0;
+	while (k < 4 && !((edgeCorners[e0][0] == faceCorners[f][k] || edgeCorners[e0][1] == faceCorners[f][k]) &&
+		(edgeCorners[e1][0] == faceCorners[f][k] || edgeCorners[e1][1] == faceCorners[f][k]))) {
+		k++;
+	}
+	if (k == 4) {
+		return lowFace;
+	}
+
+	// compare the corner with the other one of the diagonal, the first coordinate they differ in decides
+	const int* corner = cornerTable[faceCorners[f][k]];
+	const int* diagonal = cornerTable[faceCorners[f][(k + 2) % 4]];
+	int a = corner[0] != diagonal[0] ? 0 : corner[1] != diagonal[1] ? 1 : 2;
+	return lowFace == (corner[a] < diagonal[a]);
+}
+
+// squared distance between the reference vertices of two cube edges
+static float edge_distance(int e0, int e1) {
+	float distance = 0.0f;
+	for (int a = 0; a < 3; a++) {
+		distance += (vertTable[e0][a] - vertTable[e1][a]) * (vertTable[e0][a] - vertTable[e1][a]);
+	}
+	return distance;
+}
+
+// find the band of triangles joining two loops into a tube, each triangle has one side on a loop and two chords across
+// the cube, with centre set one stretch of the band may be fanned around the CUBE_CENTER vertex instead and with
+// faceChords set chords in a face are allowed (see face_chord_allowed) as long as no triangle lies in the face, the band
+// with the shortest chords between the edge midpoints is added to triangles, returns its length or -1 if there is none
+static float zip_loops(const std::vector<int>& loop0, const std::vector<int>& loop1, bool centre, bool faceChords, std::vector<int>& triangles) {
+	// added per chord in a face, so as few of them as possible are used
+	const float FACE_CHORD_COST = 100.0f;
+
+	size_t n0 = loop0.size(), n1 = loop1.size();
+	size_t width = n1 + 1, last = n0 * width + n1;
+	float bestLength = -1.0f;
+	std::vector<int> best;
+
+	// chords between the loops' vertices do not depend on where the band starts, -1 where there is none
+	std::vector<float> chords(n0 * n1);
+	for (size_t v0 = 0; v0 < n0; v0++) {
+		for (size_t v1 = 0; v1 < n1; v1++) {
+			int e0 = loop0[v0], e1 = loop1[v1];
+			if (!share_face(e0, e1)) {
+				chords[v0 * n1 + v1] = edge_distance(e0, e1);
+			}
+			else {
+				chords[v0 * n1 + v1] = faceChords && face_chord_allowed(e0, e1) ? edge_distance(e0, e1) + FACE_CHORD_COST : -1.0f;
+			}
+		}
+	}
+
+	std::vector<float> length(last + 1);
+	std::vector<int> step(last + 1);
+	for (size_t start = 0; start < n0; start++) {
+		for (size_t offset = 0; offset < n1; offset++) {
+			// chord (i, j) joins the i-th vertex of loop0 from start and the j-th vertex of loop1 walked backwards from
+			// offset, so both loops keep their direction in the band
+			auto vertex0 = [&](size_t i) { return loop0[(start + i) % n0]; };
+			auto vertex1 = [&](size_t j) { return loop1[(offset + n1 - j % n1) % n1]; };
+			auto chord = [&](size_t i, size_t j) { return chords[(start + i) % n0 * n1 + (offset + n1 - j % n1) % n1]; };
+			auto flat = [&](int e0, int e1, int e2) { return faceChords && in_one_face(e0, e1, e2); };
+
+			// length[i * width + j] is the shortest band from chord (0, 0) to chord (i, j), -1 where no band gets there,
+			// step is how it got there: 0 along loop0, 1 along loop1, 2 around the centre from chord (0, 0)
+			std::fill(length.begin(), length.end(), -1.0f);
+			std::fill(step.begin(), step.end(), 0);
+			length[0] = chord(0, 0);
+			if (length[0] < 0.0f) {
+				continue;
+			}
+
+			// chords (0, j) and (n0, j), or (i, 0) and (i, n1), are the same chord, a band must not pass one twice:
+			// every band starts along loop0 and ends along loop1 for some start and offset, so bands without the centre
+			// are only searched in that form, and a stretch around the centre covers at least one side of each loop
+			for (size_t i = 0; i <= n0; i++) {
+				for (size_t j = 0; j <= n1; j++) {
+					size_t at = i * width + j;
+					float length_ij = at == 0 ? -1.0f : chord(i, j);
+					if (length_ij < 0.0f || (centre ? i == 0 || j == 0 : i == n0 && j == 0)) {
+						continue;
+					}
+					// the stretch around the centre cannot go all the way round either loop
+					if (centre && i < n0 && j < n1) {
+						length[at] = length[0] + length_ij;
+						step[at] = 2;
+					}
+					if (i > 0 && (centre || at != last) && length[at - width] >= 0.0f && !flat(vertex0(i - 1), vertex0(i), vertex1(j)) &&
+						(length[at] < 0.0f || length[at - width] + length_ij < length[at])) {
+						length[at] = length[at - width] + length_ij;
+						step[at] = 0;
+					}
+					if (j > 0 && (centre || i > 0) && length[at - 1] >= 0.0f && !flat(vertex1(j), vertex1(j - 1), vertex0(i)) &&
+						(length[at] < 0.0f || length[at - 1] + length_ij < length[at])) {
+						length[at] = length[at - 1] + length_ij;
+						step[at] = 1;
+					}
+				}
+			}
+
+			if (length[last] < 0.0f || (bestLength >= 0.0f && length[last] >= bestLength)) {
+				continue;
+			}
+
+			// walk the band back from the last chord, which is the first one again
+			bestLength = length[last];
+			best.clear();
+			for (size_t at = last; at != 0;) {
+				size_t i = at / width, j = at % width;
+				if (step[at] == 0) {
+					best.insert(best.end(), { vertex0(i - 1), vertex0(i), vertex1(j) });
+					at -= width;
+				}
+				else if (step[at] == 1) {
+					best.insert(best.end(), { vertex1(j), vertex1(j - 1), vertex0(i) });
+					at -= 1;
+				}
+				else {
+					// along loop0 up to i, across to loop1 and back along it to the first chord
+					std::vector<int> stretch;
+					for (size_t k = 0; k <= i; k++) {
+						stretch.push_back(vertex0(k));
+					}
+					for (size_t k = j + 1; k-- > 0;) {
+						stretch.push_back(vertex1(k));
+					}
+					for (size_t v = 0; v < stretch.size(); v++) {
+						best.insert(best.end(), { stretch[v], stretch[(v + 1) % stretch.size()], CUBE_CENTER });
+					}
+					at = 0;
+				}
+			}
+		}
+	}
+
+	triangles.insert(triangles.end(), best.begin(), best.end());
+	return bestLength;
+}
+
+// a loop with pockets of consecutive vertices cut off by chords across the cube, the tube then starts from the
+// shorter loop and the pockets are closed like polygons of their own (see triangulate)
+struct ShrunkLoop {
+	std::vector<int> loop;
+	std::vector<int> pockets;
+};
+
+// every way to shrink a loop, by the number of vertices cut off
+static std::vector<std::vector<ShrunkLoop>> shrink_loop(const std::vector<int>& loop) {
+	size_t n = loop.size();
+	std::vector<std::vector<ShrunkLoop>> shrunk(n);
+	for (unsigned kept = 0; kept < (1u << n); kept++) {
+		std::vector<size_t> vertices;
+		for (size_t v = 0; v < n; v++) {
+			if ((kept >> v) & 1) {
+				vertices.push_back(v);
+			}
+		}
+		if (vertices.size() < 3) {
+			continue;
+		}
+
+		ShrunkLoop result;
+		bool valid = true;
+		for (size_t k = 0; k < vertices.size() && valid; k++) {
+			size_t from = vertices[k], to = vertices[(k + 1) % vertices.size()];
+			result.loop.push_back(loop[from]);
+			if ((from + 1) % n == to) {
+				continue;
+			}
+			std::vector<int> pocket;
+			for (size_t v = from; v != to; v = (v + 1) % n) {
+				pocket.push_back(loop[v]);
+			}
+			pocket.push_back(loop[to]);
+			valid = !share_face(loop[from], loop[to]) && triangulate(pocket, result.pockets);
+		}
+		if (valid) {
+			shrunk[n - vertices.size()].push_back(result);
+		}
+	}
+	return shrunk;
+}
+
+// join two loops with a tube, returns false if there is none: chords across the cube are preferred, cutting as few
+// vertices as possible off the loops into pockets, then a stretch of the band fanned around the centre, and chords in
+// the cube's faces only where the loops face each other across faces alone (the tube around a corner whose three faces
+// are all ambiguous cannot be built otherwise)
+static bool join_loops(const std::vector<int>& loop0, const std::vector<int>& loop1, std::vector<int>& triangles) {
+	std::vector<std::vector<ShrunkLoop>> shrunk0 = shrink_loop(loop0), shrunk1 = shrink_loop(loop1);
+	// pass 0 uses chords across the cube alone, pass 1 adds the centre, pass 2 chords in faces
+	for (int pass = 0; pass < 3; pass++) {
+		for (size_t removed = 0; removed < shrunk0.size() + shrunk1.size() - 1; removed++) {
+			float bestLength = -1.0f;
+			std::vector<int> best;
+			for (size_t removed0 = 0; removed0 <= removed && removed0 < shrunk0.size(); removed0++) {
+				if (removed - removed0 >= shrunk1.size()) {
+					continue;
+				}
+				for (const ShrunkLoop& s0 : shrunk0[removed0]) {
+					for (const ShrunkLoop& s1 : shrunk1[removed - removed0]) {
+						std::vector<int> tube;
+						float length = zip_loops(s0.loop, s1.loop, pass >= 1, pass == 2, tube);
+						if (length >= 0.0f && (bestLength < 0.0f || length < bestLength)) {
+							bestLength = length;
+							best = tube;
+							best.insert(best.end(), s0.pockets.begin(), s0.pockets.end());
+							best.insert(best.end(), s1.pockets.begin(), s1.pockets.end());
+						}
+					}
+				}
+			}
+			if (bestLength >= 0.0f) {
+				triangles.insert(triangles.end(), best.begin(), best.end());
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void store_case(const std::vector<int>& triangles, signed char* entry) {
+	size_t count = 0;
+	for (int edge : triangles) {
+		entry[count++] = (signed char)edge;
+	}
+	entry[count] = -1;
+}
+
+// a resolved case in which two pieces of the cube's surface on the same side of the isosurface are connected through
+// the inside of the cube, the two loops around them are joined by a tube instead of being closed separately
+struct TunnelCase {
+	// a corner of each of the two connected pieces
+	int corner0, corner1;
+	signed char triangles[RESOLVED_CASE_SIZE];
+};
+
+// every case with every resolution of its ambiguous faces, and the tunnels each one can form
+struct ResolvedCases {
+	std::vector<signed char> triangles;
+	std::vector<std::vector<TunnelCase>> tunnels;
+};
+
+// build the triangles for one case and one resolution of its ambiguous faces, plus a tunnel variant for every pair of
+// loops that run around two different pieces of one side of the isosurface and both border the same piece of the
+// other side, which is where the interpolant can open a tube between them
+// tubes already built for a pair of loops, empty if there is none, as the same few pairs recur across many cases
+typedef std::map<std::pair<std::vector<int>, std::vector<int>>, std::vector<int>> TubeCache;
+
+static void build_resolved_case(int theCase, int faceBits, signed char* triangles, std::vector<TunnelCase>& tunnels, TubeCache& tubes) {
+	std::vector<std::vector<int>> loops = surface_loops(theCase, faceBits);
+
+	std::vector<int> closed;
+	for (const std::vector<int>& loop : loops) {
+		close_loop(loop, closed);
+	}
+	store_case(closed, triangles);
+
+	int parent[8];
+	boundary_components(theCase, faceBits, parent);
+
+	// the pieces inside and outside the isosurface on either side of each loop
+	std::vector<int> insidePiece, outsidePiece;
+	for (const std::vector<int>& loop : loops) {
+		int c0 = edgeCorners[loop[0]][0], c1 = edgeCorners[loop[0]][1];
+		bool inside0 = (theCase >> c0) & 1;
+		insidePiece.push_back(find_corner(parent, inside0 ? c0 : c1));
+		outsidePiece.push_back(find_corner(parent, inside0 ? c1 : c0));
+	}
+
+	for (size_t l0 = 0; l0 < loops.size(); l0++) {
+		for (size_t l1 = l0 + 1; l1 < loops.size(); l1++) {
+			TunnelCase tunnel;
+			if (outsidePiece[l0] == outsidePiece[l1] && insidePiece[l0] != insidePiece[l1]) {
+				tunnel.corner0 = insidePiece[l0];
+				tunnel.corner1 = insidePiece[l1];
+			}
+			else if (insidePiece[l0] == insidePiece[l1] && outsidePiece[l0] != outsidePiece[l1]) {
+				tunnel.corner0 = outsidePiece[l0];
+				tunnel.corner1 = outsidePiece[l1];
+			}
+			else {
+				continue;
+			}
+
+			std::pair<std::vector<int>, std::vector<int>> key(loops[l0], loops[l1]);
+			TubeCache::iterator cached = tubes.find(key);
+			if (cached == tubes.end()) {
+				std::vector<int> joined;
+				join_loops(loops[l0], loops[l1], joined);
+				cached = tubes.emplace(key, joined).first;
+			}
+			if (cached->second.empty()) {
+				continue;
+			}
+			std::vector<int> tube = cached->second;
+			for (size_t l = 0; l < loops.size(); l++) {
+				if (l != l0 && l != l1) {
+					close_loop(loops[l], tube);
+				}
+			}
+			// every tube fits, a variant that did not would be left out rather than overflow the entry
+			if (tube.size() >= RESOLVED_CASE_SIZE) {
+				continue;
+			}
+			store_case(tube, tunnel.triangles);
+			tunnels.push_back(tunnel);
+		}
+	}
+}
+
+// body test: join the pieces of the cube's surface that the trilinear interpolant connects through the inside of the
+// cube, every slice y = t is a bilinear patch so each region of a slice reaches the sides of the cube, two pieces are
+// connected inside the cube exactly when some slice connects them, and a slice only changes where one of its corners
+// or its saddle crosses the isovalue, so one slice between each pair of such crossings is tested with the face decider
+static void join_through_body(const float scalars[8], float isoValue, int* parent) {
+	// slice corner k runs along the cube edge from corner k to corner k + 4, value = bottom + t * rise
+	float bottom[4], rise[4];
+	for (int k = 0; k < 4; k++) {
+		bottom[k] = scalars[k] - isoValue;
+		rise[k] = scalars[k + 4] - scalars[k];
+	}
+
+	float crossings[8] = { 0.0f, 1.0f };
+	int count = 2;
+	for (int k = 0; k < 4; k++) {
+		if (bottom[k] * (bottom[k] + rise[k]) < 0.0f) {
+			crossings[count++] = -bottom[k] / rise[k];
+		}
+	}
+
+	// the saddle value of a slice changes sign with a * c - b * d, a quadratic in t
+	float qa = rise[0] * rise[2] - rise[1] * rise[3];
+	float qb = bottom[0] * rise[2] + rise[0] * bottom[2] - bottom[1] * rise[3] - rise[1] * bottom[3];
+	float qc = bottom[0] * bottom[2] - bottom[1] * bottom[3];
+	float roots[2];
+	int rootCount = 0;
+	if (qa != 0.0f) {
+		float discriminant = qb * qb - 4.0f * qa * qc;
+		if (discriminant >= 0.0f) {
+			float root = std::sqrt(discriminant);
+			roots[rootCount++] = (-qb - root) / (2.0f * qa);
+			roots[rootCount++] = (-qb + root) / (2.0f * qa);
+		}
+	}
+	else if (qb != 0.0f) {
+		roots[rootCount++] = -qc / qb;
+	}
+	for (int r = 0; r < rootCount; r++) {
+		if (roots[r] > 0.0f && roots[r] < 1.0f) {
+			crossings[count++] = roots[r];
+		}
+	}
+	for (int c = 1; c < count; c++) {
+		for (int d = c; d > 0 && crossings[d] < crossings[d - 1]; d--) {
+			std::swap(crossings[d], crossings[d - 1]);
+		}
+	}
+
+	for (int s = 0; s + 1 < count; s++) {
+		if (crossings[s + 1] <= crossings[s]) {
+			continue;
+		}
+		float t = 0.5f * (crossings[s] + crossings[s + 1]);
+		float v[4];
+		int piece[4];
+		for (int k = 0; k < 4; k++) {
+			v[k] = bottom[k] + t * rise[k];
+			// the slice corner belongs to the piece of the cube corner on its side of the isosurface
+			piece[k] = (v[k] < 0.0f) == (bottom[k] < 0.0f) ? k : k + 4;
+		}
+
+		bool ambiguous = ((v[0] < 0.0f) == (v[2] < 0.0f)) && ((v[1] < 0.0f) == (v[3] < 0.0f)) && ((v[0] < 0.0f) != (v[1] < 0.0f));
+		if (!ambiguous) {
+			continue;
+		}
+		bool insideConnected = (v[0] * v[2] - v[1] * v[3]) / ((v[0] + v[2]) - (v[1] + v[3])) < 0.0f;
+		if ((v[0] < 0.0f) == insideConnected) {
+			join_corners(parent, piece[0], piece[2]);
+		}
+		else {
+			join_corners(parent, piece[1], piece[3]);
+		}
+	}
+}
+
+// asymptotic decider: bit f is set when face f is ambiguous and the bilinear saddle of the face lies inside
+// the surface, meaning the two inside corners of the face are connected
+int ambiguous_face_bits(const float scalars[8], float isoValue) {
+	int faceBits = 0;
+	for (int f = 0; f < 6; f++) {
+		float a = scalars[faceCorners[f][0]];
+		float b = scalars[faceCorners[f][1]];
+		float c = scalars[faceCorners[f][2]];
+		float d = scalars[faceCorners[f][3]];
+
+		// only faces whose diagonal corners agree with each other but not with the other diagonal are ambiguous
+		bool ambiguous = ((a < isoValue) == (c < isoValue)) && ((b < isoValue) == (d < isoValue)) && ((a < isoValue) != (b < isoValue));
+		if (!ambiguous) {
+			continue;
+		}
+
+		// value of the bilinear interpolant at its saddle point, the diagonals are summed separately so the cube on the
+		// other side of the face, which walks the corners in a different order, rounds to exactly the same value
+		float saddle = (a * c - b * d) / ((a + c) - (b + d));
+		if (saddle < isoValue) {
+			faceBits |= 1 << f;
+		}
+	}
+	return faceBits;
+}
+
+// triangle edges (indices for vertTable or CUBE_CENTER, -1 terminated) for a cube, with its ambiguous faces resolved by
+// the asymptotic decider and its inside by the body test
+const signed char* resolved_case(int theCase, const float scalars[8], float isoValue) {
+	// the full subcase table is built once, on first use
+	static const ResolvedCases table = [] {
+		ResolvedCases cases;
+		cases.triangles.resize(256 * 64 * RESOLVED_CASE_SIZE);
+		cases.tunnels.resize(256 * 64);
+		TubeCache tubes;
+		for (int theCase = 0; theCase < 256; theCase++) {
+			for (int faceBits = 0; faceBits < 64; faceBits++) {
+				int entry = theCase * 64 + faceBits;
+				build_resolved_case(theCase, faceBits, &cases.triangles[entry * RESOLVED_CASE_SIZE], cases.tunnels[entry], tubes);
+			}
+		}
+		return cases;
+	}();
+
+	int faceBits = ambiguous_face_bits(scalars, isoValue);
+	int entry = theCase * 64 + faceBits;
+
+	// the body test only runs for the few cases that can form a tunnel
+	if (!table.tunnels[entry].empty()) {
+		int parent[8];
+		boundary_components(theCase, faceBits, parent);
+		join_through_body(scalars, isoValue, parent);
+		for (const TunnelCase& tunnel : table.tunnels[entry]) {
+			if (find_corner(parent, tunnel.corner0) == find_corner(parent, tunnel.corner1)) {
+				return tunnel.triangles;
+			}
+		}
+	}
+	return &table.triangles[entry * RESOLVED_CASE_SIZE];
+}
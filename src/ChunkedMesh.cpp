@@ -0,0 +1,80 @@
+#include "../include/ChunkedMesh.h"
+#include "../include/MarchingCubes.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+
+// split the cells of a sampled lattice into chunks of chunkCells^3 cells, laid out x-major
+std::vector<MeshChunk> chunk_layout(const ScalarGrid& grid, int chunkCells)
+{
+	std::vector<MeshChunk> chunks;
+
+	// the last chunk along each axis may be smaller
+	int chunkCounts[3];
+	for (int a = 0; a < 3; a++) {
+		chunkCounts[a] = (grid.dims[a] - 1 + chunkCells - 1) / chunkCells;
+	}
+	for (int ci = 0; ci < chunkCounts[0]; ci++) {
+		for (int cj = 0; cj < chunkCounts[1]; cj++) {
+			for (int ck = 0; ck < chunkCounts[2]; ck++) {
+				MeshChunk chunk;
+				int c[3] = { ci, cj, ck };
+				for (int a = 0; a < 3; a++) {
+					chunk.cellBegin[a] = c[a] * chunkCells;
+					chunk.cellEnd[a] = std::min(chunk.cellBegin[a] + chunkCells, grid.dims[a] - 1);
+					chunk.boundsMin[a] = grid.position(a, (float)chunk.cellBegin[a]);
+					chunk.boundsMax[a] = grid.position(a, (float)chunk.cellEnd[a]);
+				}
+				chunk.first = 0;
+				chunk.count = 0;
+				chunks.push_back(chunk);
+			}
+		}
+	}
+	return chunks;
+}
+
+// marching cubes over a sampled lattice split into chunks of chunkCells^3 cells, the chunks are extracted in parallel
+ChunkedMesh marching_cubes_chunked(const ScalarGrid& grid, float isoValue, int chunkCells, bool resolveAmbiguity)
+{
+	ChunkedMesh chunked;
+	chunked.chunks = chunk_layout(grid, chunkCells);
+
+	// every chunk is marched into its own list
+	std::vector<std::vector<float>> chunkVertices(chunked.chunks.size());
+	parallel_for(0, (int)chunked.chunks.size(), [&](int begin, int end, int) {
+		for (int c = begin; c < end; c++) {
+			marching_cubes_cells(grid, isoValue, chunked.chunks[c].cellBegin, chunked.chunks[c].cellEnd, resolveAmbiguity, chunkVertices[c]);
+		}
+	});
+
+	place_chunks(chunkVertices, chunked);
+
+	return chunked;
+}
+
+// lay out the triangles of every chunk back to back in chunked.vertices, setting each chunk's first and count
+void place_chunks(const std::vector<std::vector<float>>& chunkVertices, ChunkedMesh& chunked)
+{
+	// place the chunks back to back, then copy them into place in parallel
+	size_t total = 0;
+	for (size_t c = 0; c < chunked.chunks.size(); c++) {
+		chunked.chunks[c].first = total;
+		chunked.chunks[c].count = chunkVertices[c].size() / 3;
+		total += chunked.chunks[c].count;
+	}
+	chunked.vertices.resize(total * 3);
+	parallel_for(0, (int)chunked.chunks.size(), [&](int begin, int end, int) {
+		for (int c = begin; c < end; c++) {
+			std::copy(chunkVertices[c].begin(), chunkVertices[c].end(), chunked.vertices.begin() + chunked.chunks[c].first * 3);
+		}
+	});
+}
+
+// re-extract the triangles of a single chunk, e.g. after the samples it covers have changed
+std::vector<float> marching_cubes_chunk(const ScalarGrid& grid, float isoValue, const MeshChunk& chunk, bool resolveAmbiguity)
+{
+	std::vector<float> vertices;
+	marching_cubes_cells(grid, isoValue, chunk.cellBegin, chunk.cellEnd, resolveAmbiguity, vertices);
+	return vertices;
+}
@@ -1,7 +1,11 @@
 #include "../include/ComputeNormals.h"
+#include "../include/Parallel.h"
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 
 // compute normals function
 std::vector<float> compute_normals(const std::vector<float>& vertices) {
@@ -31,3 +35,105 @@ std::vector<float> compute_normals(const std::vector<float>& vertices) {
 	}
     return normals;
 }
+
+// smooth normals for an indexed mesh, one unit normal per vertex averaging the faces around it
+std::vector<float> compute_vertex_normals(const Mesh& mesh, NormalWeighting weighting)
+{
+	size_t vertexCount = mesh.vertices.size() / 3;
+	int triangleCount = (int)(mesh.indices.size() / 3);
+	std::vector<float> normals(vertexCount * 3, 0.0f);
+	if (triangleCount == 0) {
+		return normals;
+	}
+
+	// each worker accumulates its run of triangles into its own buffer instead of sharing one through atomics
+	// the buffer only spans the vertices those triangles use, which for meshes from the extractors (vertices and
+	// triangles both ordered along x) is about 1 / workers of the mesh
+	int workers = worker_count();
+	std::vector<std::vector<float>> partial(workers);
+	std::vector<size_t> partialFirst(workers, 0);
+
+	parallel_for(0, triangleCount, [&](int begin, int end, int worker) {
+		// a worker left without triangles keeps an empty buffer, which the reduction below skips
+		if (begin == end) {
+			return;
+		}
+		unsigned int lowest = mesh.indices[begin * 3], highest = lowest;
+		for (size_t c = (size_t)begin * 3; c < (size_t)end * 3; c++) {
+			lowest = std::min(lowest, mesh.indices[c]);
+			highest = std::max(highest, mesh.indices[c]);
+		}
+		std::vector<float>& sums = partial[worker];
+		sums.assign(((size_t)highest - lowest + 1) * 3, 0.0f);
+		partialFirst[worker] = lowest;
+
+		for (int t = begin; t < end; t++) {
+			const unsigned int* corner = &mesh.indices[(size_t)t * 3];
+			const float* p[3] = { &mesh.vertices[corner[0] * 3], &mesh.vertices[corner[1] * 3], &mesh.vertices[corner[2] * 3] };
+
+			// the cross product of two edges is twice the area of the triangle
+			float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+			float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+			float n[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+
+			float weight[3] = { 1.0f, 1.0f, 1.0f };
+			if (weighting == ANGLE_WEIGHTED) {
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length == 0.0f) {
+					// a degenerate triangle has no direction to contribute
+					continue;
+				}
+				for (int c = 0; c < 3; c++) {
+					// the angle at corner c between the edges to the other two corners, atan2 stays accurate near 0 and pi
+					const float* a = p[c];
+					const float* b = p[(c + 1) % 3];
+					const float* d = p[(c + 2) % 3];
+					float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+					float v[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+					float dot = u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+					// every corner of a triangle has the same |u x v|, twice the area
+					weight[c] = std::atan2(length, dot) / length;
+				}
+			}
+
+			for (int c = 0; c < 3; c++) {
+				float* sum = &sums[(corner[c] - lowest) * 3];
+				sum[0] += n[0] * weight[c];
+				sum[1] += n[1] * weight[c];
+				sum[2] += n[2] * weight[c];
+			}
+		}
+	});
+
+	// every worker reduces its own range of vertices, adding the partial sums in worker order so the result does not
+	// depend on timing
+	parallel_for(0, (int)vertexCount, [&](int begin, int end, int) {
+		for (int w = 0; w < workers; w++) {
+			size_t first = partialFirst[w];
+			size_t last = first + partial[w].size() / 3;
+			size_t from = std::max((size_t)begin, first);
+			size_t to = std::min((size_t)end, last);
+			for (size_t v = from; v < to; v++) {
+				normals[v * 3] += partial[w][(v - first) * 3];
+				normals[v * 3 + 1] += partial[w][(v - first) * 3 + 1];
+				normals[v * 3 + 2] += partial[w][(v - first) * 3 + 2];
+			}
+		}
+
+		// kept free of branches so it vectorizes
+		float* n = normals.data() + (size_t)begin * 3;
+		for (int v = 0; v < end - begin; v++) {
+			float length2 = n[v * 3] * n[v * 3] + n[v * 3 + 1] * n[v * 3 + 1] + n[v * 3 + 2] * n[v * 3 + 2];
+			float scale = length2 > 0.0f ? 1.0f / std::sqrt(length2) : 0.0f;
+			n[v * 3] *= scale;
+			n[v * 3 + 1] *= scale;
+			n[v * 3 + 2] *= scale;
+		}
+	});
+
+	return normals;
+}
@@ -0,0 +1,364 @@
+#include "../include/Decimate.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+// symmetric 4x4 error quadric stored as aa, ab, ac, ad, bb, bc, bd, cc, cd, dd
+struct Quadric {
+	double q[10];
+};
+
+// an edge collapse waiting in the queue, stamps detect entries made stale by later collapses
+struct Collapse {
+	double cost;
+	unsigned int u, v;
+	unsigned int stampU, stampV;
+	float position[3];
+
+	bool operator>(const Collapse& other) const {
+		return cost > other.cost;
+	}
+};
+
+// error of moving a vertex with quadric q to p
+static double quadric_error(const Quadric& quadric, const double p[3]) {
+	const double* q = quadric.q;
+	return q[0] * p[0] * p[0] + 2 * q[1] * p[0] * p[1] + 2 * q[2] * p[0] * p[2] + 2 * q[3] * p[0]
+		+ q[4] * p[1] * p[1] + 2 * q[5] * p[1] * p[2] + 2 * q[6] * p[1]
+		+ q[7] * p[2] * p[2] + 2 * q[8] * p[2]
+		+ q[9];
+}
+
+// cross product of (b - a) and (c - a)
+static void triangle_normal(const float* a, const float* b, const float* c, double n[3]) {
+	double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// best position and cost for collapsing edge (u, v)
+static Collapse plan_collapse(unsigned int u, unsigned int v, const std::vector<Quadric>& quadrics, const std::vector<float>& positions,
+	const std::vector<unsigned int>& stamps)
+{
+	Quadric sum;
+	for (int i = 0; i < 10; i++) {
+		sum.q[i] = quadrics[u].q[i] + quadrics[v].q[i];
+	}
+	const double* q = sum.q;
+
+	Collapse collapse;
+	collapse.u = u;
+	collapse.v = v;
+	collapse.stampU = stamps[u];
+	collapse.stampV = stamps[v];
+
+	// the optimal position solves A p = -b, use Cramer's rule when A is well conditioned
+	double det = q[0] * (q[4] * q[7] - q[5] * q[5]) - q[1] * (q[1] * q[7] - q[5] * q[2]) + q[2] * (q[1] * q[5] - q[4] * q[2]);
+	double scale = q[0] + q[4] + q[7];
+	// the planes are weighted by area and their normals are unit length, so the diagonal adds up to the total area of
+	// the faces; dividing by it turns the area weighted error into a mean squared distance (length^2), independent of
+	// how finely the surface is tessellated
+	double area = scale > 0 ? scale : 1.0;
+	if (std::fabs(det) > 1e-9 * scale * scale * scale) {
+		double bx = -q[3], by = -q[6], bz = -q[8];
+		double p[3] = {
+			(bx * (q[4] * q[7] - q[5] * q[5]) - q[1] * (by * q[7] - q[5] * bz) + q[2] * (by * q[5] - q[4] * bz)) / det,
+			(q[0] * (by * q[7] - q[5] * bz) - bx * (q[1] * q[7] - q[5] * q[2]) + q[2] * (q[1] * bz - by * q[2])) / det,
+			(q[0] * (q[4] * bz - by * q[5]) - q[1] * (q[1] * bz - by * q[2]) + bx * (q[1] * q[5] - q[4] * q[2])) / det
+		};
+
+		// keep the optimum only if it stays near the edge, far away solutions come from nearly flat regions
+		double length2 = 0, distance2 = 0;
+		for (int a = 0; a < 3; a++) {
+			double mid = 0.5 * (positions[u * 3 + a] + positions[v * 3 + a]);
+			length2 += (positions[u * 3 + a] - positions[v * 3 + a]) * (positions[u * 3 + a] - positions[v * 3 + a]);
+			distance2 += (p[a] - mid) * (p[a] - mid);
+		}
+		if (distance2 <= length2) {
+			collapse.cost = quadric_error(sum, p) / area;
+			for (int a = 0; a < 3; a++) {
+				collapse.position[a] = (float)p[a];
+			}
+			return collapse;
+		}
+	}
+
+	// otherwise pick the best of the two end points and the midpoint
+	collapse.cost = INFINITY;
+	for (int candidate = 0; candidate < 3; candidate++) {
+		double p[3];
+		for (int a = 0; a < 3; a++) {
+			double pu = positions[u * 3 + a], pv = positions[v * 3 + a];
+			p[a] = candidate == 0 ? pu : (candidate == 1 ? pv : 0.5 * (pu + pv));
+		}
+		double cost = quadric_error(sum, p) / area;
+		if (cost < collapse.cost) {
+			collapse.cost = cost;
+			for (int a = 0; a < 3; a++) {
+				collapse.position[a] = (float)p[a];
+			}
+		}
+	}
+	return collapse;
+}
+
+// simplify an indexed mesh with quadric error edge collapses, stopping once it has at most targetTriangles triangles
+// or the cheapest remaining collapse would move the surface by more than maxError, measured as the area weighted mean
+// squared distance of the new vertex to the planes of the original faces around the edge
+// vertices on open borders of the mesh are kept in place
+Mesh decimate_mesh(const Mesh& mesh, size_t targetTriangles, float maxError, DecimationStats& stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	size_t vertexCount = mesh.vertices.size() / 3;
+	size_t faceCount = mesh.indices.size() / 3;
+	std::vector<float> positions = mesh.vertices;
+	std::vector<unsigned int> faces = mesh.indices;
+
+	// faces around every vertex
+	std::vector<std::vector<unsigned int>> vertexFaces(vertexCount);
+	for (size_t f = 0; f < faceCount; f++) {
+		for (int c = 0; c < 3; c++) {
+			vertexFaces[faces[f * 3 + c]].push_back((unsigned int)f);
+		}
+	}
+
+	// every vertex starts with the area weighted quadrics of the planes of its faces, each worker owns a range of
+	// vertices so no two workers write the same quadric
+	std::vector<Quadric> quadrics(vertexCount);
+	parallel_for(0, (int)vertexCount, [&](int begin, int end, int) {
+		for (int v = begin; v < end; v++) {
+			Quadric& quadric = quadrics[v];
+			std::fill(quadric.q, quadric.q + 10, 0.0);
+			for (unsigned int f : vertexFaces[v]) {
+				double n[3];
+				const float* a = &positions[faces[f * 3] * 3];
+				triangle_normal(a, &positions[faces[f * 3 + 1] * 3], &positions[faces[f * 3 + 2] * 3], n);
+				double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length == 0) {
+					continue;
+				}
+				// the cross product is twice the area, so the plane is weighted by its area
+				double area = 0.5 * length;
+				double nx = n[0] / length, ny = n[1] / length, nz = n[2] / length;
+				double d = -(nx * a[0] + ny * a[1] + nz * a[2]);
+				double plane[4] = { nx, ny, nz, d };
+				int index = 0;
+				for (int r = 0; r < 4; r++) {
+					for (int c = r; c < 4; c++) {
+						quadric.q[index++] += area * plane[r] * plane[c];
+					}
+				}
+			}
+		}
+	});
+
+	// list every edge once, edges used by a single face lie on a border and pin both of their vertices
+	std::vector<uint64_t> edges;
+	edges.reserve(faceCount * 3);
+	for (size_t f = 0; f < faceCount; f++) {
+		for (int c = 0; c < 3; c++) {
+			uint64_t a = faces[f * 3 + c], b = faces[f * 3 + (c + 1) % 3];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<char> locked(vertexCount, 0);
+	std::vector<uint64_t> uniqueEdges;
+	for (size_t e = 0; e < edges.size();) {
+		size_t run = e;
+		while (run < edges.size() && edges[run] == edges[e]) {
+			run++;
+		}
+		if (run - e == 1) {
+			locked[edges[e] >> 32] = 1;
+			locked[edges[e] & 0xffffffff] = 1;
+		}
+		uniqueEdges.push_back(edges[e]);
+		e = run;
+	}
+
+	// plan the first collapse of every edge in parallel, then queue them cheapest first
+	std::vector<unsigned int> stamps(vertexCount, 0);
+	std::vector<Collapse> planned(uniqueEdges.size());
+	std::vector<char> plannedUsable(uniqueEdges.size(), 0);
+	parallel_for(0, (int)uniqueEdges.size(), [&](int begin, int end, int) {
+		for (int e = begin; e < end; e++) {
+			unsigned int u = (unsigned int)(uniqueEdges[e] >> 32), v = (unsigned int)(uniqueEdges[e] & 0xffffffff);
+			if (!locked[u] && !locked[v]) {
+				planned[e] = plan_collapse(u, v, quadrics, positions, stamps);
+				plannedUsable[e] = 1;
+			}
+		}
+	});
+
+	std::vector<Collapse> heap;
+	for (size_t e = 0; e < planned.size(); e++) {
+		if (plannedUsable[e]) {
+			heap.push_back(planned[e]);
+		}
+	}
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue(std::greater<Collapse>(), std::move(heap));
+
+	std::vector<char> faceAlive(faceCount, 1);
+	std::vector<char> vertexAlive(vertexCount, 1);
+	size_t aliveFaces = faceCount;
+	std::vector<unsigned int> neighboursU, neighboursV;
+
+	// vertices sharing a face with v
+	auto neighbours = [&](unsigned int v, std::vector<unsigned int>& result) {
+		result.clear();
+		for (unsigned int f : vertexFaces[v]) {
+			for (int c = 0; c < 3; c++) {
+				if (faces[f * 3 + c] != v) {
+					result.push_back(faces[f * 3 + c]);
+				}
+			}
+		}
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+	};
+
+	// collapses run one at a time on this thread: each one changes the cost and validity of the plans up to two edges
+	// away, and applying independent sets of collapses in parallel rounds has to replan and reclaim those
+	// neighbourhoods every round, about three times the work per collapse of popping this queue
+	while (aliveFaces > targetTriangles && !queue.empty()) {
+		Collapse collapse = queue.top();
+		queue.pop();
+
+		if (collapse.cost > maxError) {
+			break;
+		}
+		unsigned int u = collapse.u, v = collapse.v;
+		if (!vertexAlive[u] || !vertexAlive[v] || stamps[u] != collapse.stampU || stamps[v] != collapse.stampV) {
+			continue;
+		}
+
+		// link condition: an interior edge must have exactly two common neighbours or the collapse pinches the surface
+		neighbours(u, neighboursU);
+		neighbours(v, neighboursV);
+		if (!std::binary_search(neighboursU.begin(), neighboursU.end(), v)) {
+			continue;
+		}
+		size_t common = 0;
+		for (unsigned int w : neighboursU) {
+			common += std::binary_search(neighboursV.begin(), neighboursV.end(), w);
+		}
+		if (common != 2) {
+			continue;
+		}
+
+		// reject the collapse if any surviving face around u or v would flip over or turn into a sliver
+		bool rejected = false;
+		for (unsigned int moved : { u, v }) {
+			for (unsigned int f : vertexFaces[moved]) {
+				unsigned int* face = &faces[f * 3];
+				bool hasU = face[0] == u || face[1] == u || face[2] == u;
+				bool hasV = face[0] == v || face[1] == v || face[2] == v;
+				if (hasU && hasV) {
+					continue;
+				}
+				const float* corners[3];
+				for (int c = 0; c < 3; c++) {
+					corners[c] = face[c] == moved ? collapse.position : &positions[face[c] * 3];
+				}
+				double before[3], after[3];
+				triangle_normal(&positions[face[0] * 3], &positions[face[1] * 3], &positions[face[2] * 3], before);
+				triangle_normal(corners[0], corners[1], corners[2], after);
+				double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				double lengths = std::sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2])
+					* (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+				if (lengths == 0 || dot < 0.2 * lengths) {
+					rejected = true;
+				}
+
+				// slivers have unreliable normals and tend to fold over in later collapses
+				double edges2 = 0;
+				for (int c = 0; c < 3; c++) {
+					for (int a = 0; a < 3; a++) {
+						double d = corners[c][a] - corners[(c + 1) % 3][a];
+						edges2 += d * d;
+					}
+				}
+				double afterLength = std::sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+				if (afterLength < 0.05 * edges2) {
+					rejected = true;
+				}
+			}
+		}
+		if (rejected) {
+			continue;
+		}
+
+		// merge v into u: faces using both disappear, the rest of v's faces now use u
+		for (unsigned int f : vertexFaces[v]) {
+			unsigned int* face = &faces[f * 3];
+			if (face[0] == u || face[1] == u || face[2] == u) {
+				faceAlive[f] = 0;
+				aliveFaces--;
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				if (face[c] == v) {
+					face[c] = u;
+				}
+			}
+			vertexFaces[u].push_back(f);
+		}
+
+		// drop the removed faces from the lists of the vertices that still reference them
+		for (unsigned int w : neighboursV) {
+			std::vector<unsigned int>& list = vertexFaces[w];
+			list.erase(std::remove_if(list.begin(), list.end(), [&](unsigned int f) { return !faceAlive[f]; }), list.end());
+		}
+		vertexFaces[v].clear();
+		vertexAlive[v] = 0;
+
+		for (int a = 0; a < 3; a++) {
+			positions[u * 3 + a] = collapse.position[a];
+		}
+		for (int i = 0; i < 10; i++) {
+			quadrics[u].q[i] += quadrics[v].q[i];
+		}
+		stamps[u]++;
+
+		// queue fresh collapses for the edges around u
+		neighbours(u, neighboursU);
+		for (unsigned int w : neighboursU) {
+			if (!locked[w]) {
+				queue.push(plan_collapse(u, w, quadrics, positions, stamps));
+			}
+		}
+	}
+
+	// compact the surviving faces and the vertices they use
+	Mesh result;
+	std::vector<unsigned int> remap(vertexCount, UINT32_MAX);
+	for (size_t f = 0; f < faceCount; f++) {
+		if (!faceAlive[f]) {
+			continue;
+		}
+		for (int c = 0; c < 3; c++) {
+			unsigned int v = faces[f * 3 + c];
+			if (remap[v] == UINT32_MAX) {
+				remap[v] = (unsigned int)(result.vertices.size() / 3);
+				result.vertices.insert(result.vertices.end(), { positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2] });
+			}
+			result.indices.push_back(remap[v]);
+		}
+	}
+
+	stats.trianglesBefore = faceCount;
+	stats.trianglesAfter = result.indices.size() / 3;
+	stats.reductionRatio = faceCount == 0 ? 1.0f : (float)stats.trianglesAfter / faceCount;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
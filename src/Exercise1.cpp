@@ -5,8 +5,23 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <functional>
+#include <cfloat>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #include "../include/MarchingCubes.h"
+#include "../include/SurfaceNets.h"
+#include "../include/Decimate.h"
+#include "../include/LevelOfDetail.h"
+#include "../include/ChunkedMesh.h"
+#include "../include/FieldExpression.h"
+#include "../include/Pipeline.h"
+#include "../include/Partition.h"
+#include "../include/Sequence.h"
+#include "../include/SparseGrid.h"
+#include "../include/GridCache.h"
+#include "../include/Progressive.h"
 #include "../include/ComputeNormals.h"
 #include "../include/PlyWriter.h"
 
@@ -297,8 +312,17 @@ void setupShadersForMarching(GLuint& VAO, GLuint& VBOvertices, GLuint& VBOnormal
     glUseProgram(0);
 }
 
-// function to draw marching volume
-void drawMarch(GLuint VAO, GLuint shaderProgram, std::vector<float>& vertices) {
+// function to replace the vertices and normals of the marching volume
+void updateMarchBuffers(GLuint VBOvertices, GLuint VBOnormals, std::vector<float>& vertices, std::vector<float>& normals) {
+    glBindBuffer(GL_ARRAY_BUFFER, VBOvertices);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, VBOnormals);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), normals.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// function to draw ranges of the marching volume (counts[r] vertices starting at firsts[r]) in a single call
+void drawMarch(GLuint VAO, GLuint shaderProgram, const GLint* firsts, const GLsizei* counts, GLsizei ranges) {
 
     glm::mat4 model = glm::mat4(1.0f);
 
@@ -326,12 +350,42 @@ void drawMarch(GLuint VAO, GLuint shaderProgram, std::vector<float>& vertices) {
     
     // bind VAO and draw triangles
     glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 3);
+    glMultiDrawArrays(GL_TRIANGLES, firsts, counts, ranges);
 
     glBindVertexArray(0);
     glUseProgram(0);
 }
 
+// function to draw marching volume (count vertices starting at first)
+void drawMarch(GLuint VAO, GLuint shaderProgram, size_t first, size_t count) {
+    GLint rangeFirst = (GLint)first;
+    GLsizei rangeCount = (GLsizei)count;
+    drawMarch(VAO, shaderProgram, &rangeFirst, &rangeCount, 1);
+}
+
+// function to test whether a chunk's bounding box can be seen through the camera
+bool chunkVisible(const glm::mat4& MVP, const MeshChunk& chunk) {
+    for (int p = 0; p < 6; p++) {
+        // the frustum planes are the last row of the MVP matrix plus or minus one of the other rows
+        int row = p / 2;
+        float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        float plane[4];
+        for (int c = 0; c < 4; c++) {
+            plane[c] = MVP[c][3] + sign * MVP[c][row];
+        }
+
+        // if even the box corner furthest along the plane normal is behind the plane, the box is outside
+        float distance = plane[3];
+        for (int a = 0; a < 3; a++) {
+            distance += plane[a] * (plane[a] > 0.0f ? chunk.boundsMax[a] : chunk.boundsMin[a]);
+        }
+        if (distance < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // function to handle user input (camera movement)
 void handleUserInput(GLFWwindow* window, float& r, float& theta, float& phi) {
     // set speeds
@@ -382,8 +436,24 @@ void handleUserInput(GLFWwindow* window, float& r, float& theta, float& phi) {
     view = glm::lookAt(cameraPosition, cameraPosition + cameraDirection, up);
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+    // partitioned extraction (see partitions below) starts copies of this program to extract single boxes
+    if (argc == 3 && std::string(argv[1]) == "--partition-worker") {
+        return run_partition_job(argv[2]) ? 0 : -1;
+    }
+
+    // the field can be given as an expression on the command line, e.g. Exercise1 "y - sin(x) * cos(z)", otherwise f1 is used
+    CompiledField field;
+    bool useExpression = argc > 1;
+    if (useExpression) {
+        std::string error;
+        if (!compile_field(argv[1], field, error)) {
+            std::cerr << "Invalid field expression: " << error << std::endl;
+            return -1;
+        }
+    }
+
     GLFWwindow* window;
 
     /* Initialize the library */
@@ -425,15 +495,157 @@ int main(void)
     GLuint VAOmarch, VBOvert, VBOnorm, shaderProgramMarch;
     float stepSize = 0.03f;
     float isoVal = 0.0f;
-    // call marching cubes function to get vertices
-    std::vector<float> vertices = marching_cubes(f1, isoVal, min, max, stepSize);
-    // call compute normals function to get normals
-    std::vector<float> normals = compute_normals(vertices);
+    // set to true to extract with surface nets (one vertex per cell, fewer triangles) instead of marching cubes
+    bool useSurfaceNets = false;
+    // set to true to resolve ambiguous faces with the asymptotic decider (marching cubes only)
+    bool resolveAmbiguity = false;
+    // set below 1 to decimate the mesh down to that fraction of its triangles before drawing
+    float decimateTo = 1.0f;
+    // set to true to build marching cubes meshes at 1x, 2x, 4x and 8x the step and draw the one matching the camera distance
+    bool useLod = false;
+    // camera distance up to which the full resolution level is drawn
+    float lodDistance = 10.0f;
+    // set to true to extract the mesh in chunks of 32^3 cells and only draw the chunks inside the view frustum
+    bool useChunks = false;
+    // set above 1 to split an expression field into partitions^3 boxes that are extracted by separate worker processes
+    // (at most partitionProcesses at a time) and welded back together
+    int partitions = 1;
+    int partitionProcesses = 4;
+    bool usePartitions = useExpression && partitions > 1;
+    // set to true to only keep the 8^3 sample blocks near the surface in memory and march just those (marching cubes only)
+    bool useSparse = false;
+    // set to true to draw a mesh at 8x the step right away and refine it in the background until stepSize is reached
+    // (marching cubes only)
+    bool useProgressive = false;
+    // the chunk, lod and decimation modes need the whole dense grid
+    bool useDenseGrid = !usePartitions && !useSparse && !useProgressive;
+    // set to true to keep sampled grids in the grid_cache directory (up to gridCacheMegabytes) and reuse them in later runs
+    // with the same field, min, max and stepSize
+    bool useGridCache = false;
+    size_t gridCacheMegabytes = 2048;
+    // set to true for smooth angle weighted vertex normals instead of one normal per triangle (indexed meshes only, so
+    // not with the chunk, lod or sparse modes)
+    bool smoothNormals = false;
+
+    // sample the field once, every extraction mode below works from the same samples (partition workers sample their own boxes)
+    ScalarGrid grid;
+    if (useDenseGrid && useGridCache) {
+        GridCache cache = open_grid_cache("grid_cache", gridCacheMegabytes * 1024 * 1024);
+        // f1 is keyed by the build time of this file, so editing it never picks up stale grids
+        grid = useExpression
+            ? cached_sample_grid(cache, field, min, max, stepSize)
+            : cached_sample_grid(cache, "f1 " __DATE__ " " __TIME__, f1, min, max, stepSize);
+        std::cout << "Grid cache: " << cache.hits << " hits, " << cache.misses << " misses, " << cache.evictions << " evictions, "
+            << cache.corrupt << " corrupt, " << grid_cache_bytes(cache) / (1024 * 1024) << " MB in use" << std::endl;
+    }
+    else if (useDenseGrid) {
+        grid = useExpression ? sample_grid(field, min, max, stepSize) : sample_grid(f1, min, max, stepSize);
+    }
+
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    // expand an indexed mesh for drawing, with smooth normals if asked for
+    auto useMesh = [&](const Mesh& mesh) {
+        vertices = mesh_to_soup(mesh);
+        if (smoothNormals) {
+            Mesh normalMesh = { compute_vertex_normals(mesh), mesh.indices };
+            normals = mesh_to_soup(normalMesh);
+        }
+    };
+    LodMesh lod;
+    ChunkedMesh chunked;
+    // the progressive passes are handed from the background thread to the render loop through progressiveVertices
+    std::thread progressiveThread;
+    std::mutex progressiveMutex;
+    std::vector<float> progressiveVertices;
+    bool progressiveReady = false;
+    std::atomic<bool> progressiveCancel(false);
+    if (usePartitions) {
+        Mesh mesh;
+        std::string error;
+        if (!marching_cubes_partitioned(field, isoVal, min, max, stepSize, partitions, partitionProcesses, argv[0], "partition",
+            resolveAmbiguity, mesh, error)) {
+            std::cerr << "Partitioned extraction failed: " << error << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        useMesh(mesh);
+    }
+    else if (useSparse) {
+        SparseGrid sparse = useExpression
+            ? sample_sparse_grid(field, isoVal, min, max, stepSize)
+            : sample_sparse_grid(f1, isoVal, min, max, stepSize);
+        std::cout << sparse.leaves.size() << " of " << sparse.blocks.size() << " blocks active, "
+            << sparse_grid_bytes(sparse) / (1024 * 1024) << " MB" << std::endl;
+        vertices = marching_cubes_sparse(sparse, resolveAmbiguity);
+    }
+    else if (useProgressive) {
+        progressiveThread = std::thread([&]() {
+            auto onPass = [&](const ProgressivePass& pass) {
+                std::lock_guard<std::mutex> lock(progressiveMutex);
+                progressiveVertices = pass.vertices;
+                progressiveReady = true;
+                // closing the window stops the refinement
+                return !progressiveCancel.load();
+            };
+            ProgressiveStats stats = useExpression
+                ? marching_cubes_progressive(field, isoVal, min, max, stepSize, onPass, 8, resolveAmbiguity)
+                : marching_cubes_progressive(f1, isoVal, min, max, stepSize, onPass, 8, resolveAmbiguity);
+            std::cout << "First mesh after " << stats.timeToFirstMesh << "s, " << stats.passes << " passes in " << stats.seconds << "s"
+                << (stats.cancelled ? " (cancelled)" : "") << std::endl;
+        });
+    }
+    else if (useChunks) {
+        chunked = marching_cubes_chunked(grid, isoVal, 32, resolveAmbiguity);
+        vertices = chunked.vertices;
+    }
+    else if (useLod) {
+        // all levels share one sampling pass and one vertex buffer
+        lod = marching_cubes_lod(grid, isoVal, 4, resolveAmbiguity);
+        vertices = lod.vertices;
+    }
+    else if (decimateTo < 1.0f) {
+        // decimation works on the indexed mesh
+        Mesh mesh = useSurfaceNets
+            ? surface_nets(grid, isoVal)
+            : marching_cubes_indexed(grid, isoVal, resolveAmbiguity);
+        DecimationStats stats;
+        mesh = decimate_mesh(mesh, (size_t)(mesh.indices.size() / 3 * decimateTo), FLT_MAX, stats);
+        std::cout << "Decimated " << stats.trianglesBefore << " -> " << stats.trianglesAfter << " triangles (ratio "
+            << stats.reductionRatio << ") in " << stats.seconds << "s" << std::endl;
+        useMesh(mesh);
+    }
+    else if (smoothNormals) {
+        useMesh(useSurfaceNets ? surface_nets(grid, isoVal) : marching_cubes_indexed(grid, isoVal, resolveAmbiguity));
+    }
+    else {
+        // call marching cubes (or surface nets) function to get vertices
+        vertices = useSurfaceNets
+            ? mesh_to_soup(surface_nets(grid, isoVal))
+            : marching_cubes(grid, isoVal, resolveAmbiguity);
+    }
+    // call compute normals function to get faceted normals, unless smooth ones were computed above
+    if (normals.empty()) {
+        normals = compute_normals(vertices);
+    }
     setupShadersForMarching(VAOmarch, VBOvert, VBOnorm, shaderProgramMarch, vertices, normals);
 
     //// write the ply
     //std::string fileName = "Function1";
     //writePLY(vertices, normals, fileName);
+    //// or stream the ply slab by slab, overlapping extraction, normals and writing
+    //PipelineStats pipelineStats = useExpression
+    //    ? write_ply_pipelined(field, isoVal, min, max, stepSize, fileName)
+    //    : write_ply_pipelined(f1, isoVal, min, max, stepSize, fileName);
+    //std::cout << pipelineStats.triangles << " triangles in " << pipelineStats.seconds << "s (extract "
+    //    << pipelineStats.extractSeconds << "s, normals " << pipelineStats.normalSeconds << "s, write "
+    //    << pipelineStats.writeSeconds << "s)" << std::endl;
+
+    //// write an animation of f1 rising over 60 frames, bricks that did not change keep their triangles from the last frame
+    //SequenceStats sequenceStats = write_sequence([](float x, float y, float z, float t) { return f1(x, y - t, z); },
+    //    isoVal, min, max, stepSize, 60, 0.05f, fileName + ".mcseq");
+    //std::cout << sequenceStats.framesPerSecond << " frames per second, " << sequenceStats.reusedBricks << " bricks reused, "
+    //    << sequenceStats.extractedBricks << " extracted" << std::endl;
     
     // set clear color
     glClearColor(0.2f, 0.2f, 0.3f, 0.0f);
@@ -443,6 +655,10 @@ int main(void)
     float theta = 45.0f;
     float phi = 45.0f;
 
+    // ranges of the chunks drawn in a frame, kept between frames so they are not reallocated
+    std::vector<GLint> visibleFirsts;
+    std::vector<GLsizei> visibleCounts;
+
     /* Loop until the user closes the window */
     while (!glfwWindowShouldClose(window))
     {
@@ -455,8 +671,42 @@ int main(void)
         // draw the cube edges
         drawCubeEdges(VAO, axesVAO, shaderProgram);
 
-        // draw the marching volume
-        drawMarch(VAOmarch, shaderProgramMarch, vertices);
+        // pick up the latest progressive pass
+        if (useProgressive) {
+            std::lock_guard<std::mutex> lock(progressiveMutex);
+            if (progressiveReady) {
+                vertices.swap(progressiveVertices);
+                normals = compute_normals(vertices);
+                updateMarchBuffers(VBOvert, VBOnorm, vertices, normals);
+                progressiveReady = false;
+            }
+        }
+
+        // draw the marching volume (partitioned and sparse extractions are always drawn whole)
+        if (useChunks && useDenseGrid) {
+            // collect the chunks that survive frustum culling and draw them all with one call, so the shader and
+            // its uniforms are set up once per frame
+            glm::mat4 MVP = projection * view;
+            visibleFirsts.clear();
+            visibleCounts.clear();
+            for (const MeshChunk& chunk : chunked.chunks) {
+                if (chunk.count > 0 && chunkVisible(MVP, chunk)) {
+                    visibleFirsts.push_back((GLint)chunk.first);
+                    visibleCounts.push_back((GLsizei)chunk.count);
+                }
+            }
+            if (!visibleFirsts.empty()) {
+                drawMarch(VAOmarch, shaderProgramMarch, visibleFirsts.data(), visibleCounts.data(), (GLsizei)visibleFirsts.size());
+            }
+        }
+        else if (useLod && useDenseGrid) {
+            // draw the level of detail for the current camera distance
+            int level = select_lod_level(lod, r, lodDistance);
+            drawMarch(VAOmarch, shaderProgramMarch, lod.levelOffsets[level], lod.levelOffsets[level + 1] - lod.levelOffsets[level]);
+        }
+        else {
+            drawMarch(VAOmarch, shaderProgramMarch, 0, vertices.size() / 3);
+        }
 
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
@@ -465,6 +715,12 @@ int main(void)
         glfwPollEvents();
     }
 
+    // let the progressive extraction finish its current pass
+    if (progressiveThread.joinable()) {
+        progressiveCancel = true;
+        progressiveThread.join();
+    }
+
     // cleanup buffers before exit
     glDeleteVertexArrays(1, &VAO);
     glDeleteVertexArrays(1, &axesVAO);
@@ -0,0 +1,569 @@
+#include "../include/FieldExpression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+// node kinds of the expression graph that are not bytecode operations
+#define NODE_X      100
+#define NODE_Y      101
+#define NODE_Z      102
+#define NODE_CONST  103
+
+// samples evaluated per instruction dispatch
+#define FIELD_ROW   256
+
+// one node of the expression graph, children always come before their parents
+struct FieldNode {
+	int op;
+	int a, b;
+	float value;
+};
+
+// builds the expression graph while parsing, identical nodes are only created once (common subexpression
+// elimination) and operations on constants are evaluated right away (constant folding)
+struct FieldBuilder {
+	std::vector<FieldNode> nodes;
+	std::map<std::tuple<int, int, int, uint32_t>, int> lookup;
+
+	int add(int op, int a, int b, float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		auto key = std::make_tuple(op, a, b, bits);
+		auto found = lookup.find(key);
+		if (found != lookup.end()) {
+			return found->second;
+		}
+		nodes.push_back({ op, a, b, value });
+		lookup[key] = (int)nodes.size() - 1;
+		return (int)nodes.size() - 1;
+	}
+
+	int constant(float value) {
+		return add(NODE_CONST, -1, -1, value);
+	}
+
+	bool is_constant(int node, float value) const {
+		return nodes[node].op == NODE_CONST && nodes[node].value == value;
+	}
+
+	int operation(int op, int a, int b = -1) {
+		bool binary = op <= OP_POW && op != OP_NEG;
+
+		// order the operands of commutative operations so a + b and b + a share a node
+		if ((op == OP_ADD || op == OP_MUL || op == OP_MIN || op == OP_MAX) && a > b) {
+			std::swap(a, b);
+		}
+
+		// fold operations whose operands are all constants
+		if (nodes[a].op == NODE_CONST && (!binary || nodes[b].op == NODE_CONST)) {
+			float u = nodes[a].value;
+			float v = binary ? nodes[b].value : 0.0f;
+			switch (op) {
+			case OP_ADD: return constant(u + v);
+			case OP_SUB: return constant(u - v);
+			case OP_MUL: return constant(u * v);
+			case OP_DIV: return constant(u / v);
+			case OP_NEG: return constant(-u);
+			case OP_MIN: return constant(std::min(u, v));
+			case OP_MAX: return constant(std::max(u, v));
+			case OP_POW: return constant(std::pow(u, v));
+			case OP_SIN: return constant(std::sin(u));
+			case OP_COS: return constant(std::cos(u));
+			case OP_TAN: return constant(std::tan(u));
+			case OP_EXP: return constant(std::exp(u));
+			case OP_LOG: return constant(std::log(u));
+			case OP_SQRT: return constant(std::sqrt(u));
+			case OP_ABS: return constant(std::fabs(u));
+			}
+		}
+
+		// identities that leave the other operand unchanged
+		if ((op == OP_ADD && is_constant(a, 0.0f)) || (op == OP_MUL && is_constant(a, 1.0f))) {
+			return b;
+		}
+		if (((op == OP_ADD || op == OP_SUB) && is_constant(b, 0.0f)) || ((op == OP_MUL || op == OP_DIV || op == OP_POW) && is_constant(b, 1.0f))) {
+			return a;
+		}
+		if (op == OP_NEG && nodes[a].op == OP_NEG) {
+			return nodes[a].a;
+		}
+		// like std::pow, x^0 is 1 for every x
+		if (op == OP_POW && is_constant(b, 0.0f)) {
+			return constant(1.0f);
+		}
+
+		// small whole powers become multiplications, x^2 is far cheaper as x * x than as exp(2 * log(x)), x^-1 becomes
+		// 1 / x
+		if (op == OP_POW && nodes[b].op == NODE_CONST) {
+			float exponent = nodes[b].value;
+			if (exponent == std::floor(exponent) && std::fabs(exponent) >= 1.0f && std::fabs(exponent) <= 16.0f) {
+				int n = (int)std::fabs(exponent);
+				int result = -1;
+				int square = a;
+				// exponentiation by squaring
+				while (n > 0) {
+					if (n & 1) {
+						result = result == -1 ? square : operation(OP_MUL, result, square);
+					}
+					n >>= 1;
+					if (n > 0) {
+						square = operation(OP_MUL, square, square);
+					}
+				}
+				return exponent < 0 ? operation(OP_DIV, constant(1.0f), result) : result;
+			}
+			if (exponent == 0.5f) {
+				return operation(OP_SQRT, a);
+			}
+		}
+
+		return add(op, a, b, 0.0f);
+	}
+};
+
+// recursive descent parser producing nodes in a FieldBuilder
+struct FieldParser {
+	const std::string& text;
+	size_t position;
+	FieldBuilder& builder;
+	std::string error;
+
+	FieldParser(const std::string& expression, FieldBuilder& target) : text(expression), position(0), builder(target) {}
+
+	void skip_spaces() {
+		while (position < text.size() && std::isspace((unsigned char)text[position])) {
+			position++;
+		}
+	}
+
+	bool accept(char c) {
+		skip_spaces();
+		if (position < text.size() && text[position] == c) {
+			position++;
+			return true;
+		}
+		return false;
+	}
+
+	int fail(const std::string& message) {
+		if (error.empty()) {
+			error = message + " at position " + std::to_string(position);
+		}
+		return -1;
+	}
+
+	// expression := term (('+' | '-') term)*
+	int expression() {
+		int node = term();
+		while (node != -1) {
+			if (accept('+')) {
+				int right = term();
+				node = right == -1 ? -1 : builder.operation(OP_ADD, node, right);
+			}
+			else if (accept('-')) {
+				int right = term();
+				node = right == -1 ? -1 : builder.operation(OP_SUB, node, right);
+			}
+			else {
+				break;
+			}
+		}
+		return node;
+	}
+
+	// term := unary (('*' | '/') unary)*
+	int term() {
+		int node = unary();
+		while (node != -1) {
+			if (accept('*')) {
+				int right = unary();
+				node = right == -1 ? -1 : builder.operation(OP_MUL, node, right);
+			}
+			else if (accept('/')) {
+				int right = unary();
+				node = right == -1 ? -1 : builder.operation(OP_DIV, node, right);
+			}
+			else {
+				break;
+			}
+		}
+		return node;
+	}
+
+	// unary := '-' unary | '+' unary | power
+	int unary() {
+		if (accept('-')) {
+			int node = unary();
+			return node == -1 ? -1 : builder.operation(OP_NEG, node);
+		}
+		if (accept('+')) {
+			return unary();
+		}
+		return power();
+	}
+
+	// power := primary ('^' unary)?, so 2^3^2 = 2^(3^2) and -x^2 = -(x^2)
+	int power() {
+		int node = primary();
+		if (node != -1 && accept('^')) {
+			int exponent = unary();
+			return exponent == -1 ? -1 : builder.operation(OP_POW, node, exponent);
+		}
+		return node;
+	}
+
+	// primary := number | variable | constant | function '(' arguments ')' | '(' expression ')'
+	int primary() {
+		skip_spaces();
+		if (position >= text.size()) {
+			return fail("unexpected end of expression");
+		}
+
+		if (accept('(')) {
+			int node = expression();
+			if (node != -1 && !accept(')')) {
+				return fail("expected ')'");
+			}
+			return node;
+		}
+
+		char c = text[position];
+		if (std::isdigit((unsigned char)c) || c == '.') {
+			const char* start = text.c_str() + position;
+			char* end = nullptr;
+			float value = std::strtof(start, &end);
+			position += end - start;
+			return builder.constant(value);
+		}
+
+		if (!std::isalpha((unsigned char)c) && c != '_') {
+			return fail(std::string("unexpected '") + c + "'");
+		}
+		size_t start = position;
+		while (position < text.size() && (std::isalnum((unsigned char)text[position]) || text[position] == '_')) {
+			position++;
+		}
+		std::string name = text.substr(start, position - start);
+
+		if (name == "x") {
+			return builder.add(NODE_X, -1, -1, 0.0f);
+		}
+		if (name == "y") {
+			return builder.add(NODE_Y, -1, -1, 0.0f);
+		}
+		if (name == "z") {
+			return builder.add(NODE_Z, -1, -1, 0.0f);
+		}
+		if (name == "pi") {
+			return builder.constant(3.14159265358979f);
+		}
+		if (name == "e") {
+			return builder.constant(2.71828182845905f);
+		}
+
+		static const std::map<std::string, FieldOp> unaryFunctions = {
+			{ "sin", OP_SIN }, { "cos", OP_COS }, { "tan", OP_TAN }, { "exp", OP_EXP },
+			{ "log", OP_LOG }, { "sqrt", OP_SQRT }, { "abs", OP_ABS },
+		};
+		static const std::map<std::string, FieldOp> binaryFunctions = {
+			{ "min", OP_MIN }, { "max", OP_MAX }, { "pow", OP_POW },
+		};
+
+		auto unaryFunction = unaryFunctions.find(name);
+		auto binaryFunction = binaryFunctions.find(name);
+		if (unaryFunction == unaryFunctions.end() && binaryFunction == binaryFunctions.end()) {
+			position = start;
+			return fail("unknown name '" + name + "'");
+		}
+		if (!accept('(')) {
+			return fail("expected '(' after " + name);
+		}
+		int first = expression();
+		if (first == -1) {
+			return -1;
+		}
+		if (binaryFunction != binaryFunctions.end()) {
+			if (!accept(',')) {
+				return fail("expected ',' in " + name);
+			}
+			int second = expression();
+			if (second == -1) {
+				return -1;
+			}
+			if (!accept(')')) {
+				return fail("expected ')'");
+			}
+			return builder.operation(binaryFunction->second, first, second);
+		}
+		if (!accept(')')) {
+			return fail("expected ')'");
+		}
+		return builder.operation(unaryFunction->second, first);
+	}
+};
+
+// parse an expression in x, y and z, e.g. "y - sin(x) * cos(z)", folding constants and sharing repeated
+// subexpressions, then compile it to register bytecode
+// supports + - * / ^, parentheses, pi, e, sin cos tan exp log sqrt abs (one argument) and min max pow (two arguments)
+// returns false and describes the problem in error if the expression is invalid
+bool compile_field(const std::string& expression, CompiledField& field, std::string& error)
+{
+	FieldBuilder builder;
+	FieldParser parser(expression, builder);
+	int root = parser.expression();
+	parser.skip_spaces();
+	if (root != -1 && parser.position < expression.size()) {
+		parser.fail(std::string("unexpected '") + expression[parser.position] + "'");
+		root = -1;
+	}
+	if (root == -1) {
+		error = parser.error;
+		return false;
+	}
+
+	// folding leaves nodes behind that nothing uses, find the ones the result depends on and their last user
+	std::vector<FieldNode>& nodes = builder.nodes;
+	std::vector<char> used(nodes.size(), 0);
+	std::vector<int> lastUse(nodes.size(), -1);
+	used[root] = 1;
+	for (int n = root; n >= 0; n--) {
+		if (!used[n] || nodes[n].op >= NODE_X) {
+			continue;
+		}
+		for (int operand : { nodes[n].a, nodes[n].b }) {
+			if (operand != -1) {
+				used[operand] = 1;
+				lastUse[operand] = std::max(lastUse[operand], n);
+			}
+		}
+	}
+
+	field.source = expression;
+	field.program.clear();
+	field.constants.clear();
+
+	// inputs and constants get fixed registers
+	std::vector<int> reg(nodes.size(), -1);
+	for (size_t n = 0; n < nodes.size(); n++) {
+		if (!used[n]) {
+			continue;
+		}
+		if (nodes[n].op == NODE_X || nodes[n].op == NODE_Y || nodes[n].op == NODE_Z) {
+			reg[n] = nodes[n].op - NODE_X;
+		}
+		else if (nodes[n].op == NODE_CONST) {
+			reg[n] = 3 + (int)field.constants.size();
+			field.constants.push_back(nodes[n].value);
+		}
+	}
+
+	// temporaries are handed back as soon as their last user has read them, so a long expression still only needs
+	// a few rows of scratch space
+	int firstTemporary = 3 + (int)field.constants.size();
+	int registerCount = firstTemporary;
+	std::vector<int> freeRegisters;
+	for (size_t n = 0; n < nodes.size(); n++) {
+		if (!used[n] || nodes[n].op >= NODE_X) {
+			continue;
+		}
+		for (int operand : { nodes[n].a, nodes[n].b }) {
+			if (operand != -1 && lastUse[operand] == (int)n && reg[operand] >= firstTemporary
+				&& std::find(freeRegisters.begin(), freeRegisters.end(), reg[operand]) == freeRegisters.end()) {
+				freeRegisters.push_back(reg[operand]);
+			}
+		}
+		if (freeRegisters.empty()) {
+			reg[n] = registerCount++;
+		}
+		else {
+			reg[n] = freeRegisters.back();
+			freeRegisters.pop_back();
+		}
+
+		FieldInstruction instruction;
+		instruction.op = (FieldOp)nodes[n].op;
+		instruction.dst = (unsigned short)reg[n];
+		instruction.a = (unsigned short)reg[nodes[n].a];
+		instruction.b = (unsigned short)(nodes[n].b == -1 ? 0 : reg[nodes[n].b]);
+		field.program.push_back(instruction);
+	}
+
+	field.registerCount = registerCount;
+	field.resultRegister = reg[root];
+	return true;
+}
+
+// the math functions below are branch free so the loops calling them compile to SIMD code, they are accurate to
+// a few float ulps over the ranges scalar fields are usually sampled on
+
+// sin(x) when quadrant is 0, cos(x) when quadrant is 1
+static inline float sin_cos(float x, int quadrant) {
+	// x = k * pi/2 + r with |r| <= pi/4, pi/2 is split in three parts to keep r accurate (Cody-Waite)
+	float t = std::min(std::max(x * 0.636619772f, -1e9f), 1e9f);
+	int k = (int)(t + (t >= 0.0f ? 0.5f : -0.5f));
+	float kf = (float)k;
+	float r = x - kf * 1.5703125f;
+	r = r - kf * 4.837512969970703125e-4f;
+	r = r - kf * 7.54978995489188216e-8f;
+
+	// minimax polynomials for sin and cos on [-pi/4, pi/4]
+	float r2 = r * r;
+	float s = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+	float c = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+	// pick sin or cos of r and its sign from the quadrant
+	int q = k + quadrant;
+	float v = (q & 1) ? c : s;
+	return (q & 2) ? -v : v;
+}
+
+static inline float fast_exp(float input) {
+	// x = k * ln2 + r, then exp(x) = 2^k * exp(r), inputs beyond the clamp give inf or 0 below
+	float x = input != input ? 0.0f : std::min(std::max(input, -104.0f), 88.8f);
+	float t = x * 1.44269504088896341f;
+	int k = (int)(t + (t >= 0.0f ? 0.5f : -0.5f));
+	float kf = (float)k;
+	float r = x - kf * 0.693359375f;
+	r = r + kf * 2.12194440e-4f;
+
+	float p = 1.9875691500e-4f;
+	p = p * r + 1.3981999507e-3f;
+	p = p * r + 8.3334519073e-3f;
+	p = p * r + 4.1665795894e-2f;
+	p = p * r + 1.6666665459e-1f;
+	p = p * r + 5.0000001201e-1f;
+	p = p * r * r + r + 1.0f;
+
+	// 2^k built directly from its exponent bits, as two factors so results near the float limits overflow to inf or
+	// fall into the denormals gradually like std::exp
+	int k1 = k / 2;
+	int32_t bits[2] = { (k1 + 127) << 23, (k - k1 + 127) << 23 };
+	float scale[2];
+	std::memcpy(scale, bits, sizeof(scale));
+	float result = p * scale[0] * scale[1];
+
+	result = input > 88.7228394f ? INFINITY : result;
+	result = input < -103.972084f ? 0.0f : result;
+	return input != input ? input : result;
+}
+
+static inline float fast_log(float x) {
+	// denormals are scaled by 2^23 into the normal range first, and the 23 taken off the exponent again
+	bool denormal = x < 1.17549435e-38f;
+	float normal = denormal ? x * 8388608.0f : x;
+
+	// x = 2^e * m, with m moved into [sqrt(1/2), sqrt(2)) so log(m) stays small
+	int32_t bits;
+	std::memcpy(&bits, &normal, sizeof(bits));
+	int e = ((bits >> 23) & 0xff) - 127 - (denormal ? 23 : 0);
+	int32_t mantissaBits = (bits & 0x7fffff) | (127 << 23);
+	float m;
+	std::memcpy(&m, &mantissaBits, sizeof(m));
+	bool large = m > 1.41421356f;
+	m = large ? m * 0.5f : m;
+	float ef = (float)(large ? e + 1 : e);
+
+	float f = m - 1.0f;
+	float f2 = f * f;
+	float p = 7.0376836292e-2f;
+	p = p * f - 1.1514610310e-1f;
+	p = p * f + 1.1676998740e-1f;
+	p = p * f - 1.2420140846e-1f;
+	p = p * f + 1.4249322787e-1f;
+	p = p * f - 1.6668057665e-1f;
+	p = p * f + 2.0000714765e-1f;
+	p = p * f - 2.4999993993e-1f;
+	p = p * f + 3.3333331174e-1f;
+	float result = f + (f * f2 * p - 2.12194440e-4f * ef - 0.5f * f2) + 0.693359375f * ef;
+
+	// zero, negative and non finite inputs behave like std::log
+	result = x == 0.0f ? -INFINITY : result;
+	result = x < 0.0f || x != x ? NAN : result;
+	return x == INFINITY ? INFINITY : result;
+}
+
+// a^b computed as exp(b * log(|a|)), with the sign and zero cases of std::pow restored: a negative base gives the
+// sign of a for odd whole exponents, a positive result for even ones and NaN for fractional ones
+static inline float fast_pow(float a, float b) {
+	float magnitude = fast_exp(b * fast_log(std::fabs(a)));
+	magnitude = a == 0.0f ? (b > 0.0f ? 0.0f : (b < 0.0f ? INFINITY : 1.0f)) : magnitude;
+	float half = b * 0.5f;
+	bool whole = b == std::floor(b);
+	bool odd = whole && half != std::floor(half);
+	float negative = whole ? (odd ? -magnitude : magnitude) : NAN;
+	return a < 0.0f ? negative : magnitude;
+}
+
+// run the program on up to FIELD_ROW samples, registers holds one row pointer per register
+static void run_program(const CompiledField& field, float* const* registers, size_t n)
+{
+	for (const FieldInstruction& instruction : field.program) {
+		float* d = registers[instruction.dst];
+		const float* a = registers[instruction.a];
+		const float* b = registers[instruction.b];
+
+		switch (instruction.op) {
+		case OP_ADD: for (size_t i = 0; i < n; i++) d[i] = a[i] + b[i]; break;
+		case OP_SUB: for (size_t i = 0; i < n; i++) d[i] = a[i] - b[i]; break;
+		case OP_MUL: for (size_t i = 0; i < n; i++) d[i] = a[i] * b[i]; break;
+		case OP_DIV: for (size_t i = 0; i < n; i++) d[i] = a[i] / b[i]; break;
+		case OP_NEG: for (size_t i = 0; i < n; i++) d[i] = -a[i]; break;
+		case OP_MIN: for (size_t i = 0; i < n; i++) d[i] = std::min(a[i], b[i]); break;
+		case OP_MAX: for (size_t i = 0; i < n; i++) d[i] = std::max(a[i], b[i]); break;
+		case OP_POW: for (size_t i = 0; i < n; i++) d[i] = fast_pow(a[i], b[i]); break;
+		case OP_SIN: for (size_t i = 0; i < n; i++) d[i] = sin_cos(a[i], 0); break;
+		case OP_COS: for (size_t i = 0; i < n; i++) d[i] = sin_cos(a[i], 1); break;
+		case OP_TAN: for (size_t i = 0; i < n; i++) d[i] = sin_cos(a[i], 0) / sin_cos(a[i], 1); break;
+		case OP_EXP: for (size_t i = 0; i < n; i++) d[i] = fast_exp(a[i]); break;
+		case OP_LOG: for (size_t i = 0; i < n; i++) d[i] = fast_log(a[i]); break;
+		case OP_SQRT: for (size_t i = 0; i < n; i++) d[i] = std::sqrt(a[i]); break;
+		case OP_ABS: for (size_t i = 0; i < n; i++) d[i] = std::fabs(a[i]); break;
+		}
+	}
+}
+
+// evaluate the field at count points given as separate x, y and z arrays
+void evaluate_field_row(const CompiledField& field, const float* x, const float* y, const float* z, float* out, size_t count)
+{
+	// scratch rows and the register table are kept per thread so sampling from several workers never allocates
+	thread_local std::vector<float> scratch;
+	scratch.resize((size_t)field.registerCount * FIELD_ROW);
+
+	thread_local std::vector<float*> registers;
+	registers.resize(field.registerCount);
+	for (int r = 3; r < field.registerCount; r++) {
+		registers[r] = &scratch[(size_t)r * FIELD_ROW];
+	}
+
+	// constants only need filling once for all rows, and only as far as the longest row
+	size_t rowLength = std::min((size_t)FIELD_ROW, count);
+	for (size_t c = 0; c < field.constants.size(); c++) {
+		std::fill(registers[3 + c], registers[3 + c] + rowLength, field.constants[c]);
+	}
+
+	for (size_t begin = 0; begin < count; begin += FIELD_ROW) {
+		size_t n = std::min((size_t)FIELD_ROW, count - begin);
+
+		// the input registers read the caller's arrays directly, no instruction ever writes to them
+		registers[0] = const_cast<float*>(x + begin);
+		registers[1] = const_cast<float*>(y + begin);
+		registers[2] = const_cast<float*>(z + begin);
+
+		run_program(field, registers.data(), n);
+		std::copy(registers[field.resultRegister], registers[field.resultRegister] + n, out + begin);
+	}
+}
+
+// evaluate the field at a single point
+float evaluate_field(const CompiledField& field, float x, float y, float z)
+{
+	float result;
+	evaluate_field_row(field, &x, &y, &z, &result, 1);
+	return result;
+}
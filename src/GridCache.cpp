@@ -0,0 +1,418 @@
+#include "../include/GridCache.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// first bytes of a cached grid file, bump GRID_CACHE_VERSION whenever sampling or the layout changes
+static const char GRID_CACHE_MAGIC[8] = { 'G', 'R', 'I', 'D', 'C', 'A', 'C', 'H' };
+static const uint32_t GRID_CACHE_VERSION = 2;
+
+// fixed part of a cached grid file, followed by the field key (padded to 8 bytes) and the samples
+struct GridFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t keyLength;
+	uint64_t key;
+	float min;
+	float max;
+	float stepSize;
+	int32_t dims[3];
+	uint64_t valueCount;
+	// checksum of the samples, see checksum_values
+	uint64_t checksum;
+};
+
+
+// read-only view of a whole file
+struct MappedFile {
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int descriptor;
+#endif
+};
+
+// map a file into memory, returns false if it is missing or empty
+static bool map_file(const std::string& path, MappedFile& mapped)
+{
+	mapped.data = nullptr;
+	mapped.size = 0;
+#ifdef _WIN32
+	mapped.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mapped.file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	mapped.mapping = nullptr;
+	if (GetFileSizeEx(mapped.file, &size) && size.QuadPart > 0) {
+		mapped.mapping = CreateFileMappingA(mapped.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	}
+	if (mapped.mapping == nullptr) {
+		CloseHandle(mapped.file);
+		return false;
+	}
+	mapped.data = (const unsigned char*)MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mapped.data == nullptr) {
+		CloseHandle(mapped.mapping);
+		CloseHandle(mapped.file);
+		return false;
+	}
+	mapped.size = (size_t)size.QuadPart;
+#else
+	mapped.descriptor = open(path.c_str(), O_RDONLY);
+	if (mapped.descriptor < 0) {
+		return false;
+	}
+	struct stat info;
+	void* data = MAP_FAILED;
+	if (fstat(mapped.descriptor, &info) == 0 && info.st_size > 0) {
+		data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, mapped.descriptor, 0);
+	}
+	if (data == MAP_FAILED) {
+		close(mapped.descriptor);
+		return false;
+	}
+	// start paging the samples in while the checksum and the extraction get going
+	madvise(data, (size_t)info.st_size, MADV_WILLNEED);
+	mapped.data = (const unsigned char*)data;
+	mapped.size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+// release a view made by map_file
+static void unmap_file(MappedFile& mapped)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(mapped.data);
+	CloseHandle(mapped.mapping);
+	CloseHandle(mapped.file);
+#else
+	munmap((void*)mapped.data, mapped.size);
+	close(mapped.descriptor);
+#endif
+	mapped.data = nullptr;
+}
+
+// 64 bit FNV-1a hash of some bytes, continuing from hash
+// 64 bit FNV-1a hash of some bytes, continuing from hash
+static uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t b = 0; b < size; b++) {
+		hash = (hash ^ bytes[b]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// samples per independently hashed block of the checksum
+static const size_t CHECKSUM_BLOCK = 1 << 16;
+
+// checksum of the samples, FNV-1a over the 32 bit words of each block of CHECKSUM_BLOCK samples and then over the block
+// hashes, so the blocks are hashed in parallel straight from the mapped file
+static uint64_t checksum_values(const float* values, size_t count)
+{
+	size_t blocks = (count + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK;
+	std::vector<uint64_t> blockHashes(blocks);
+	parallel_for(0, (int)blocks, [&](int begin, int end, int) {
+		for (int b = begin; b < end; b++) {
+			size_t first = (size_t)b * CHECKSUM_BLOCK;
+			size_t last = std::min(count, first + CHECKSUM_BLOCK);
+			uint64_t hash = hash_bytes(nullptr, 0);
+			for (size_t v = first; v < last; v++) {
+				// copied rather than read through a cast pointer, which would break strict aliasing
+				uint32_t word;
+				std::memcpy(&word, &values[v], sizeof(word));
+				hash = (hash ^ word) * 1099511628211ull;
+			}
+			blockHashes[b] = hash;
+		}
+	});
+	return hash_bytes(blockHashes.data(), blockHashes.size() * sizeof(uint64_t));
+}
+
+// key of a grid from the field identity and the lattice parameters
+static uint64_t grid_key(const std::string& fieldKey, float min, float max, float stepSize)
+{
+	uint64_t hash = hash_bytes(fieldKey.data(), fieldKey.size());
+	hash = hash_bytes(&min, sizeof(float), hash);
+	hash = hash_bytes(&max, sizeof(float), hash);
+	hash = hash_bytes(&stepSize, sizeof(float), hash);
+	return hash_bytes(&GRID_CACHE_VERSION, sizeof(GRID_CACHE_VERSION), hash);
+}
+
+// file holding the grid with the given key
+static std::string grid_path(const GridCache& cache, uint64_t key)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.grid", (unsigned long long)key);
+	return cache.directory + "/" + name;
+}
+
+// file listing the entries, one "key bytes lastUse" line each
+static std::string index_path(const GridCache& cache)
+{
+	return cache.directory + "/index.txt";
+}
+
+// replace a file with one written under a temporary name, so readers never see half a file
+static bool replace_file(const std::string& temporary, const std::string& path)
+{
+	std::remove(path.c_str());
+	return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// write the index back to disk
+static void save_index(const GridCache& cache)
+{
+	std::string temporary = index_path(cache) + ".tmp";
+	{
+		std::ofstream file(temporary);
+		for (const GridCacheEntry& entry : cache.entries) {
+			file << std::hex << entry.key << std::dec << " " << entry.bytes << " " << entry.lastUse << "\n";
+		}
+	}
+	replace_file(temporary, index_path(cache));
+}
+
+// forget an entry and delete its file
+static void remove_entry(GridCache& cache, uint64_t key)
+{
+	std::remove(grid_path(cache, key).c_str());
+	cache.entries.erase(std::remove_if(cache.entries.begin(), cache.entries.end(), [&](const GridCacheEntry& entry) {
+		return entry.key == key;
+	}), cache.entries.end());
+}
+
+// evict the least recently used grids until the cache holds at most limit bytes
+static void evict_grids(GridCache& cache, size_t limit)
+{
+	std::sort(cache.entries.begin(), cache.entries.end(), [](const GridCacheEntry& a, const GridCacheEntry& b) {
+		return a.lastUse < b.lastUse;
+	});
+	while (!cache.entries.empty() && grid_cache_bytes(cache) > limit) {
+		remove_entry(cache, cache.entries.front().key);
+		cache.evictions++;
+	}
+}
+
+// open (creating it if needed) the cache in directory, reading its index of entries
+GridCache open_grid_cache(const std::string& directory, size_t maxBytes)
+{
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+
+	GridCache cache;
+	cache.directory = directory;
+	cache.maxBytes = maxBytes;
+	cache.useCounter = 0;
+	cache.hits = cache.misses = cache.evictions = cache.corrupt = 0;
+
+	std::ifstream file(index_path(cache));
+	std::string line;
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		GridCacheEntry entry;
+		if (fields >> std::hex >> entry.key >> std::dec >> entry.bytes >> entry.lastUse) {
+			cache.entries.push_back(entry);
+			cache.useCounter = std::max(cache.useCounter, entry.lastUse);
+		}
+	}
+	file.close();
+
+	// the limit may be lower than in the run that filled the cache
+	if (grid_cache_bytes(cache) > maxBytes) {
+		evict_grids(cache, maxBytes);
+		save_index(cache);
+	}
+	return cache;
+}
+
+// total size of the grids in the cache
+size_t grid_cache_bytes(const GridCache& cache)
+{
+	size_t total = 0;
+	for (const GridCacheEntry& entry : cache.entries) {
+		total += entry.bytes;
+	}
+	return total;
+}
+
+// load a cached grid, checking that the file is complete, belongs to this field and lattice and is unchanged
+// the grid borrows its samples from the mapping, which stays open until the last grid using it is gone
+static bool load_grid(const std::string& path, uint64_t key, const std::string& fieldKey, float min, float max, float stepSize, ScalarGrid& grid)
+{
+	MappedFile mapped;
+	if (!map_file(path, mapped)) {
+		return false;
+	}
+	std::shared_ptr<MappedFile> owner(new MappedFile(mapped), [](MappedFile* file) {
+		unmap_file(*file);
+		delete file;
+	});
+
+	GridFileHeader header;
+	size_t keyBytes = (fieldKey.size() + 7) / 8 * 8;
+	if (mapped.size < sizeof(header) + keyBytes) {
+		return false;
+	}
+	std::memcpy(&header, mapped.data, sizeof(header));
+	int samples = cell_count(min, max, stepSize) + 1;
+	bool valid = std::memcmp(header.magic, GRID_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+		header.version == GRID_CACHE_VERSION &&
+		header.key == key &&
+		header.keyLength == fieldKey.size() &&
+		std::memcmp(mapped.data + sizeof(header), fieldKey.data(), fieldKey.size()) == 0 &&
+		header.min == min && header.max == max && header.stepSize == stepSize &&
+		header.dims[0] == samples && header.dims[1] == samples && header.dims[2] == samples &&
+		header.valueCount == (uint64_t)samples * samples * samples &&
+		mapped.size == sizeof(header) + keyBytes + header.valueCount * sizeof(float);
+	if (!valid) {
+		return false;
+	}
+
+	// the samples start 8 byte aligned (see store_grid) and the mapping is only ever read as floats
+	const float* values = (const float*)(mapped.data + sizeof(header) + keyBytes);
+	if (checksum_values(values, (size_t)header.valueCount) != header.checksum) {
+		return false;
+	}
+
+	grid.dims[0] = grid.dims[1] = grid.dims[2] = header.dims[0];
+	grid.origin[0] = grid.origin[1] = grid.origin[2] = min;
+	grid.offset[0] = grid.offset[1] = grid.offset[2] = 0;
+	grid.stepSize = stepSize;
+	grid.values.borrow(values, (size_t)header.valueCount, owner);
+	return true;
+}
+
+// write a grid to the cache directory
+static bool store_grid(const std::string& path, uint64_t key, const std::string& fieldKey, float min, float max, const ScalarGrid& grid)
+{
+	GridFileHeader header;
+	std::memcpy(header.magic, GRID_CACHE_MAGIC, sizeof(header.magic));
+	header.version = GRID_CACHE_VERSION;
+	header.keyLength = (uint32_t)fieldKey.size();
+	header.key = key;
+	header.min = min;
+	header.max = max;
+	header.stepSize = grid.stepSize;
+	for (int a = 0; a < 3; a++) {
+		header.dims[a] = grid.dims[a];
+	}
+	header.valueCount = grid.values.size();
+	header.checksum = checksum_values(grid.values.data(), grid.values.size());
+
+	// the key is padded so the samples start 8 byte aligned in the mapping
+	std::string paddedKey = fieldKey;
+	paddedKey.resize((fieldKey.size() + 7) / 8 * 8, '\0');
+
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		file.write((const char*)&header, sizeof(header));
+		file.write(paddedKey.data(), paddedKey.size());
+		file.write((const char*)grid.values.data(), grid.values.size() * sizeof(float));
+		if (!file) {
+			file.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+	return replace_file(temporary, path);
+}
+
+// look a grid up, sampling and storing it with sample() on a miss
+static ScalarGrid lookup_grid(
+	GridCache& cache,
+	const std::string& fieldKey,
+	float min,
+	float max,
+	float stepSize,
+	const std::function<ScalarGrid()>& sample)
+{
+	uint64_t key = grid_key(fieldKey, min, max, stepSize);
+	std::string path = grid_path(cache, key);
+	auto entry = std::find_if(cache.entries.begin(), cache.entries.end(), [&](const GridCacheEntry& e) { return e.key == key; });
+
+	ScalarGrid grid;
+	if (entry != cache.entries.end()) {
+		if (load_grid(path, key, fieldKey, min, max, stepSize, grid)) {
+			cache.hits++;
+			entry->lastUse = ++cache.useCounter;
+			save_index(cache);
+			return grid;
+		}
+		// truncated, overwritten or otherwise damaged, sample again
+		cache.corrupt++;
+		remove_entry(cache, key);
+	}
+
+	cache.misses++;
+	grid = sample();
+
+	size_t bytes = sizeof(GridFileHeader) + (fieldKey.size() + 7) / 8 * 8 + grid.values.size() * sizeof(float);
+	if (bytes > cache.maxBytes) {
+		save_index(cache);
+		return grid;
+	}
+
+	evict_grids(cache, cache.maxBytes - bytes);
+
+	if (store_grid(path, key, fieldKey, min, max, grid)) {
+		GridCacheEntry added = { key, bytes, ++cache.useCounter };
+		cache.entries.push_back(added);
+	}
+	save_index(cache);
+	return grid;
+}
+
+// sample f on the lattice covering the cube [min, max]^3, or load the grid sampled by an earlier run
+ScalarGrid cached_sample_grid(
+	GridCache& cache,
+	const std::string& fieldKey,
+	std::function<float(float, float, float)> f,
+	float min,
+	float max,
+	float stepSize)
+{
+	return lookup_grid(cache, "function:" + fieldKey, min, max, stepSize, [&]() {
+		return sample_grid(f, min, max, stepSize);
+	});
+}
+
+// same as above for a compiled field, keyed by its expression
+ScalarGrid cached_sample_grid(
+	GridCache& cache,
+	const CompiledField& field,
+	float min,
+	float max,
+	float stepSize)
+{
+	return lookup_grid(cache, "expression:" + field.source, min, max, stepSize, [&]() {
+		return sample_grid(field, min, max, stepSize);
+	});
+}
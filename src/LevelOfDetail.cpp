@@ -0,0 +1,41 @@
+#include "../include/LevelOfDetail.h"
+#include "../include/MarchingCubes.h"
+
+#include <cmath>
+
+// build levels at 1, 2, 4, ... times the grid's step by subsampling the grid, the field is not evaluated again
+LodMesh marching_cubes_lod(const ScalarGrid& grid, float isoValue, int levels, bool resolveAmbiguity)
+{
+	LodMesh lod;
+	lod.levelOffsets.push_back(0);
+
+	for (int level = 0; level < levels; level++) {
+		// stop early once the grid is too small to hold a single coarse cell, level 0 is always built (possibly
+		// empty) so there is at least one level to draw
+		int factor = 1 << level;
+		if (level > 0 && (grid.dims[0] <= factor || grid.dims[1] <= factor || grid.dims[2] <= factor)) {
+			break;
+		}
+
+		std::vector<float> levelVertices = level == 0
+			? marching_cubes(grid, isoValue, resolveAmbiguity)
+			: marching_cubes(subsample_grid(grid, factor), isoValue, resolveAmbiguity);
+
+		lod.vertices.insert(lod.vertices.end(), levelVertices.begin(), levelVertices.end());
+		lod.levelOffsets.push_back(lod.vertices.size() / 3);
+		lod.levelStepSizes.push_back(grid.stepSize * factor);
+	}
+	return lod;
+}
+
+// level to draw for a camera at the given distance, the finest level is used up to fullDetailDistance and each
+// doubling of the distance after that moves one level coarser
+int select_lod_level(const LodMesh& lod, float distance, float fullDetailDistance)
+{
+	int coarsest = (int)lod.levelStepSizes.size() - 1;
+	if (coarsest <= 0 || distance <= fullDetailDistance) {
+		return 0;
+	}
+	int level = (int)std::floor(std::log2(distance / fullDetailDistance)) + 1;
+	return level > coarsest ? coarsest : level;
+}
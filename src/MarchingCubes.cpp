@@ -1,4 +1,9 @@
 #include "../include/MarchingCubes.h"
+#include "../include/Parallel.h"
+#include "../include/AmbiguityTable.h"
+
+#include <algorithm>
+#include <cstdint>
 
 #define FRONT_TOP_LEFT     128
 #define FRONT_TOP_RIGHT     64
@@ -9,10 +14,69 @@
 #define BACK_BOTTOM_RIGHT    2
 #define BACK_BOTTOM_LEFT     1
 
-// struct to hold x, y, and z coordinates of a vertex
-struct Vertex {
-	float x, y, z;
-};
+// the most triangle corners a single cube can produce (see resolved_case)
+#define MAX_CUBE_EDGES      36
+
+// find the triangles of cube (i, j, k) as a list of edges (indices for vertTable, or CUBE_CENTER), returns the list length
+static int cube_edges(const ScalarGrid& grid, float isoValue, bool resolveAmbiguity, int i, int j, int k, int* edges)
+{
+	// look up the scalar field values of the cube's 8 vertices
+	float scalars[8];
+	for (size_t c = 0; c < 8; c++) {
+		scalars[c] = grid.values[grid.index(i + cornerTable[c][0], j + cornerTable[c][1], k + cornerTable[c][2])];
+	}
+
+	// determine the case of the cube from the scalar values
+	int theCase = 0;
+
+	if (scalars[0] < isoValue) {
+		theCase |= BACK_BOTTOM_LEFT;
+	}
+	if (scalars[1] < isoValue) {
+		theCase |= BACK_BOTTOM_RIGHT;
+	}
+	if (scalars[2] < isoValue) {
+		theCase |= FRONT_BOTTOM_RIGHT;
+	}
+	if (scalars[3] < isoValue) {
+		theCase |= FRONT_BOTTOM_LEFT;
+	}
+	if (scalars[4] < isoValue) {
+		theCase |= BACK_TOP_LEFT;
+	}
+	if (scalars[5] < isoValue) {
+		theCase |= BACK_TOP_RIGHT;
+	}
+	if (scalars[6] < isoValue) {
+		theCase |= FRONT_TOP_RIGHT;
+	}
+	if (scalars[7] < isoValue) {
+		theCase |= FRONT_TOP_LEFT;
+	}
+
+	int count = 0;
+
+	if (resolveAmbiguity) {
+		// pick the subcase matching the asymptotic decider's choice for every ambiguous face and the body test's for the inside
+		const signed char* caseEdges = resolved_case(theCase, scalars, isoValue);
+		for (size_t e = 0; caseEdges[e] != -1; e++) {
+			edges[count++] = caseEdges[e];
+		}
+		return count;
+	}
+
+	// search the lookup table for the case to get the edges (basically indices for vertTable which make up triangles)
+	const int* caseEdges = marching_cubes_lut[theCase];
+
+	// loop through the edges (indices of vertices for triangles)
+	for (size_t e = 0; e < 16; e++) {
+		// ignore -1 (padding)
+		if (caseEdges[e] != -1) {
+			edges[count++] = caseEdges[e];
+		}
+	}
+	return count;
+}
 
 // the marching cubes algorithm
 std::vector<float> marching_cubes(
@@ -20,80 +84,204 @@ std::vector<float> marching_cubes(
 	float isoValue,
 	float min,
 	float max,
-	float stepSize)
+	float stepSize,
+	bool resolveAmbiguity)
 {
+	// sample the scalar field once at every lattice point, then march over the samples
+	return marching_cubes(sample_grid(f, min, max, stepSize), isoValue, resolveAmbiguity);
+}
+
+// marching cubes over a field compiled from an expression
+std::vector<float> marching_cubes(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	bool resolveAmbiguity)
+{
+	// rows of samples are evaluated together by the compiled bytecode
+	return marching_cubes(sample_grid(field, min, max, stepSize), isoValue, resolveAmbiguity);
+}
+
+// marching cubes over a lattice that has already been sampled
+std::vector<float> marching_cubes(const ScalarGrid& grid, float isoValue, bool resolveAmbiguity)
+{
+	// each worker marches its own range of x slabs into its own list, the lists are joined in order afterwards
+	std::vector<std::vector<float>> slabVertices(worker_count());
+
+	parallel_for(0, grid.dims[0] - 1, [&](int begin, int end, int worker) {
+		int cellBegin[3] = { begin, 0, 0 };
+		int cellEnd[3] = { end, grid.dims[1] - 1, grid.dims[2] - 1 };
+		marching_cubes_cells(grid, isoValue, cellBegin, cellEnd, resolveAmbiguity, slabVertices[worker]);
+	});
 
-	// define the list of vertices to return
+	// join the per-worker lists into the return list
 	std::vector<float> verticesList;
+	size_t total = 0;
+	for (const std::vector<float>& slab : slabVertices) {
+		total += slab.size();
+	}
+	verticesList.reserve(total);
+	for (const std::vector<float>& slab : slabVertices) {
+		verticesList.insert(verticesList.end(), slab.begin(), slab.end());
+	}
+	return verticesList;
+}
 
-	// loop over the grid
-	for (float x = min; x < max; x += stepSize) {
-		for (float y = min; y < max; y += stepSize) {
-			for (float z = min; z < max; z += stepSize) {
-
-				// create array to hold positions of all 8 vertices of the cube
-				Vertex positions[8] = {
-					{x, y, z},
-					{x + stepSize, y, z},
-					{x + stepSize, y + stepSize, z},
-					{x, y + stepSize, z},
-					{x, y, z + stepSize},
-					{x + stepSize, y, z + stepSize},
-					{x + stepSize, y + stepSize, z + stepSize},
-					{x, y + stepSize, z + stepSize}
-				};
-
-				// create array to hold floats representing the vertices (scalar field)
-				float scalars[8] = { 0 };
-
-				// compute the scalar field values of the cube's 8 vertices
-				for (size_t i = 0; i < 8; i++) {
-					scalars[i] = f(positions[i].x, positions[i].y, positions[i].z);
-				}
+// march the box of cells [cellBegin, cellEnd) of a sampled lattice, appending the triangle vertices to verticesList
+void marching_cubes_cells(
+	const ScalarGrid& grid,
+	float isoValue,
+	const int cellBegin[3],
+	const int cellEnd[3],
+	bool resolveAmbiguity,
+	std::vector<float>& verticesList)
+{
+	int edges[MAX_CUBE_EDGES];
 
-				// determine the case of the cube from the scalar values
-				int theCase = 0;
-				
-				if (scalars[0] < isoValue) {
-					theCase |= BACK_BOTTOM_LEFT;
-				}
-				if (scalars[1] < isoValue) {
-					theCase |= BACK_BOTTOM_RIGHT;
-				}
-				if (scalars[2] < isoValue) {
-					theCase |= FRONT_BOTTOM_RIGHT;
-				}
-				if (scalars[3] < isoValue) {
-					theCase |= FRONT_BOTTOM_LEFT;
-				}
-				if (scalars[4] < isoValue) {
-					theCase |= BACK_TOP_LEFT;
-				}
-				if (scalars[5] < isoValue) {
-					theCase |= BACK_TOP_RIGHT;
-				}
-				if (scalars[6] < isoValue) {
-					theCase |= FRONT_TOP_RIGHT;
-				}
-				if (scalars[7] < isoValue) {
-					theCase |= FRONT_TOP_LEFT;
+	// loop over the cells of the box
+	for (int i = cellBegin[0]; i < cellEnd[0]; i++) {
+		for (int j = cellBegin[1]; j < cellEnd[1]; j++) {
+			for (int k = cellBegin[2]; k < cellEnd[2]; k++) {
+				int count = cube_edges(grid, isoValue, resolveAmbiguity, i, j, k, edges);
+
+				// add the triangle's vertices to the list, positions are computed from lattice indices so
+				// neighbouring cubes produce bit-identical vertices on their shared edges
+				for (int e = 0; e < count; e++) {
+					const float* offset = edges[e] == CUBE_CENTER ? cubeCenter : vertTable[edges[e]];
+					verticesList.push_back(grid.position(0, i + offset[0]));
+					verticesList.push_back(grid.position(1, j + offset[1]));
+					verticesList.push_back(grid.position(2, k + offset[2]));
 				}
+			}
+		}
+	}
+}
+
+// id of the lattice edge starting at lattice point (i, j, k) along axis (3 for the cube centre)
+uint64_t lattice_edge_id(int i, int j, int k, int axis)
+{
+	// LATTICE_ID_BITS bits per coordinate, ordered x-major like the samples
+	return ((((uint64_t)i << LATTICE_ID_BITS | (uint64_t)j) << LATTICE_ID_BITS | (uint64_t)k) << 2) | (uint64_t)axis;
+}
+
+// lattice point of an id from lattice_edge_id, returns the axis
+int lattice_edge_point(uint64_t id, int point[3])
+{
+	const uint64_t mask = ((uint64_t)1 << LATTICE_ID_BITS) - 1;
+	point[0] = (int)(id >> (2 + 2 * LATTICE_ID_BITS) & mask);
+	point[1] = (int)(id >> (2 + LATTICE_ID_BITS) & mask);
+	point[2] = (int)(id >> 2 & mask);
+	return (int)(id & 3);
+}
+
+// marching cubes producing an indexed mesh
+Mesh marching_cubes_indexed(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	bool resolveAmbiguity)
+{
+	return marching_cubes_indexed(sample_grid(f, min, max, stepSize), isoValue, resolveAmbiguity);
+}
+
+// marching cubes over a lattice that has already been sampled, producing an indexed mesh
+Mesh marching_cubes_indexed(const ScalarGrid& grid, float isoValue, bool resolveAmbiguity)
+{
+	std::vector<uint64_t> vertexIds;
+	return marching_cubes_indexed(grid, isoValue, resolveAmbiguity, vertexIds);
+}
+
+// marching cubes producing an indexed mesh along with the lattice id of every vertex
+Mesh marching_cubes_indexed(const ScalarGrid& grid, float isoValue, bool resolveAmbiguity, std::vector<uint64_t>& vertexIds)
+{
+	// every vertex sits on a lattice edge, identified by the lattice point it starts from and its axis (0, 1, 2), or at
+	// the centre of a cube, identified by the cube's lowest corner and axis 3
+	// points are numbered by their index in the whole lattice rather than in this grid, so grids holding neighbouring
+	// parts of one lattice give the same id to the vertices on their shared planes
+	auto latticeId = [&](int i, int j, int k, int axis) {
+		return lattice_edge_id(grid.offset[0] + i, grid.offset[1] + j, grid.offset[2] + k, axis);
+	};
 
-				// search the lookup table for the case to get the edges (basically indices for vertTable which make up triangles)
-				const int* caseEdges = marching_cubes_lut[theCase];
-
-				// loop through the edges (indices of vertices for triangles)
-				for (size_t i = 0; i < 16; i++) {
-					// ignore -1 (padding)
-					if (caseEdges[i] != -1) {
-						// add the triangle's vertices to the return list
-						verticesList.push_back(x + (stepSize * vertTable[caseEdges[i]][0]));
-						verticesList.push_back(y + (stepSize * vertTable[caseEdges[i]][1]));
-						verticesList.push_back(z + (stepSize * vertTable[caseEdges[i]][2]));
+	// the lowest corner and the axis of each cube edge, relative to the cube
+	int edgeStart[12][3];
+	int edgeAxis[12];
+	for (int e = 0; e < 12; e++) {
+		const int* c0 = cornerTable[edgeCorners[e][0]];
+		const int* c1 = cornerTable[edgeCorners[e][1]];
+		for (int a = 0; a < 3; a++) {
+			edgeStart[e][a] = std::min(c0[a], c1[a]);
+			if (c0[a] != c1[a]) {
+				edgeAxis[e] = a;
+			}
+		}
+	}
+
+	// each worker collects the lattice ids of its triangle corners
+	int workers = worker_count();
+	std::vector<std::vector<uint64_t>> slabIds(workers);
+
+	parallel_for(0, grid.dims[0] - 1, [&](int begin, int end, int worker) {
+		std::vector<uint64_t>& ids = slabIds[worker];
+		int edges[MAX_CUBE_EDGES];
+
+		for (int i = begin; i < end; i++) {
+			for (int j = 0; j < grid.dims[1] - 1; j++) {
+				for (int k = 0; k < grid.dims[2] - 1; k++) {
+					int count = cube_edges(grid, isoValue, resolveAmbiguity, i, j, k, edges);
+					for (int e = 0; e < count; e++) {
+						if (edges[e] == CUBE_CENTER) {
+							ids.push_back(latticeId(i, j, k, 3));
+						}
+						else {
+							ids.push_back(latticeId(i + edgeStart[edges[e]][0], j + edgeStart[edges[e]][1], k + edgeStart[edges[e]][2], edgeAxis[edges[e]]));
+						}
 					}
 				}
 			}
 		}
+	});
+
+	// one vertex per distinct lattice id, ordered by id
+	vertexIds.clear();
+	for (const std::vector<uint64_t>& ids : slabIds) {
+		vertexIds.insert(vertexIds.end(), ids.begin(), ids.end());
+	}
+	std::sort(vertexIds.begin(), vertexIds.end());
+	vertexIds.erase(std::unique(vertexIds.begin(), vertexIds.end()), vertexIds.end());
+
+	Mesh mesh;
+	mesh.vertices.resize(vertexIds.size() * 3);
+
+	// place the vertices from their ids
+	parallel_for(0, (int)vertexIds.size(), [&](int begin, int end, int) {
+		for (int v = begin; v < end; v++) {
+			int lattice[3];
+			int axis = lattice_edge_point(vertexIds[v], lattice);
+			for (int a = 0; a < 3; a++) {
+				float offset = axis == 3 ? cubeCenter[a] : (a == axis ? 0.5f : 0.0f);
+				mesh.vertices[v * 3 + a] = grid.position(a, (lattice[a] - grid.offset[a]) + offset);
+			}
+		}
+	});
+
+	// turn the corner ids into indices, each worker keeps its own slab's triangles in order
+	std::vector<size_t> slabOffset(workers, 0);
+	for (int w = 1; w < workers; w++) {
+		slabOffset[w] = slabOffset[w - 1] + slabIds[w - 1].size();
 	}
-	return verticesList;
+	mesh.indices.resize(slabOffset[workers - 1] + slabIds[workers - 1].size());
+
+	parallel_for(0, workers, [&](int begin, int end, int) {
+		for (int w = begin; w < end; w++) {
+			for (size_t c = 0; c < slabIds[w].size(); c++) {
+				mesh.indices[slabOffset[w] + c] = (unsigned int)(std::lower_bound(vertexIds.begin(), vertexIds.end(), slabIds[w][c]) - vertexIds.begin());
+			}
+		}
+	});
+
+	return mesh;
 }
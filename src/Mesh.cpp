@@ -0,0 +1,15 @@
+#include "../include/Mesh.h"
+
+// expand an indexed mesh into the unindexed triangle list used by compute_normals, writePLY and drawMarch
+std::vector<float> mesh_to_soup(const Mesh& mesh) {
+	std::vector<float> vertices;
+	vertices.reserve(mesh.indices.size() * 3);
+
+	// copy the coordinates of every referenced vertex
+	for (unsigned int index : mesh.indices) {
+		vertices.push_back(mesh.vertices[index * 3]);
+		vertices.push_back(mesh.vertices[index * 3 + 1]);
+		vertices.push_back(mesh.vertices[index * 3 + 2]);
+	}
+	return vertices;
+}
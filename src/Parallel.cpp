@@ -0,0 +1,50 @@
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// worker limit set by set_worker_count, 0 when unset
+static std::atomic<int> workerLimit(0);
+
+// number of worker threads used by parallel_for
+int worker_count() {
+	int limit = workerLimit.load();
+	if (limit > 0) {
+		return limit;
+	}
+	// hardware_concurrency may report 0 when it cannot be determined
+	unsigned int threads = std::thread::hardware_concurrency();
+	return threads == 0 ? 1 : (int)threads;
+}
+
+// limit parallel_for to the given number of workers, 0 goes back to one per hardware thread
+void set_worker_count(int workers) {
+	workerLimit.store(std::max(0, workers));
+}
+
+// split [begin, end) into one contiguous range per worker and run body(rangeBegin, rangeEnd, worker) on each concurrently
+void parallel_for(int begin, int end, const std::function<void(int, int, int)>& body) {
+	int workers = worker_count();
+	int count = end - begin;
+
+	// nothing to split, run everything on the calling thread
+	if (workers == 1 || count <= 1) {
+		body(begin, end, 0);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	for (int w = 0; w < workers; w++) {
+		// give the first (count % workers) ranges one extra element
+		int rangeBegin = begin + (count / workers) * w + std::min(w, count % workers);
+		int rangeEnd = rangeBegin + (count / workers) + (w < count % workers ? 1 : 0);
+		threads.emplace_back(std::cref(body), rangeBegin, rangeEnd, w);
+	}
+
+	// wait for all ranges to finish
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
@@ -0,0 +1,352 @@
+#include "../include/Partition.h"
+#include "../include/ScalarGrid.h"
+#include "../include/MarchingCubes.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+// first bytes of a partial mesh file
+static const char PARTIAL_MESH_MAGIC[8] = { 'P', 'A', 'R', 'T', 'M', 'S', 'H', '1' };
+
+// split the cells of the lattice covering [min, max]^3 into partitionsPerAxis^3 boxes of (almost) equal size
+std::vector<PartitionBox> partition_domain(float min, float max, float stepSize, int partitionsPerAxis)
+{
+	int cells = cell_count(min, max, stepSize);
+	int parts = std::max(1, std::min(partitionsPerAxis, cells));
+
+	// boundaries of the boxes along one axis, the same for all three
+	std::vector<int> bounds(parts + 1);
+	for (int p = 0; p <= parts; p++) {
+		bounds[p] = (int)((long long)cells * p / parts);
+	}
+
+	std::vector<PartitionBox> boxes;
+	for (int x = 0; x < parts; x++) {
+		for (int y = 0; y < parts; y++) {
+			for (int z = 0; z < parts; z++) {
+				PartitionBox box = {
+					{ bounds[x], bounds[y], bounds[z] },
+					{ bounds[x + 1], bounds[y + 1], bounds[z + 1] }
+				};
+				boxes.push_back(box);
+			}
+		}
+	}
+	return boxes;
+}
+
+// sample and extract one box in this process
+PartialMesh extract_partition(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float stepSize,
+	const PartitionBox& box,
+	bool resolveAmbiguity)
+{
+	// the samples of a box of cells run up to and including its upper plane
+	ScalarGrid grid = sample_box(field, min, stepSize, box.cellBegin, box.cellEnd);
+
+	PartialMesh part;
+	part.mesh = marching_cubes_indexed(grid, isoValue, resolveAmbiguity, part.vertexIds);
+	return part;
+}
+
+// weld partial meshes into one, vertices on shared planes have the same lattice id in both partitions and are merged
+Mesh merge_partitions(const std::vector<PartialMesh>& parts)
+{
+	// one vertex per distinct lattice id, ordered by id like marching_cubes_indexed
+	std::vector<uint64_t> ids;
+	for (const PartialMesh& part : parts) {
+		ids.insert(ids.end(), part.vertexIds.begin(), part.vertexIds.end());
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	size_t indexCount = 0;
+	for (const PartialMesh& part : parts) {
+		indexCount += part.mesh.indices.size();
+	}
+
+	Mesh mesh;
+	mesh.vertices.resize(ids.size() * 3);
+	mesh.indices.reserve(indexCount);
+
+	for (const PartialMesh& part : parts) {
+		// both id lists are sorted, so the global index of each partial vertex is found in a single merge walk
+		std::vector<unsigned int> remap(part.vertexIds.size());
+		size_t g = 0;
+		for (size_t v = 0; v < part.vertexIds.size(); v++) {
+			while (ids[g] != part.vertexIds[v]) {
+				g++;
+			}
+			remap[v] = (unsigned int)g;
+			// seam vertices are computed from the same lattice index on both sides, so either copy can be kept
+			for (int a = 0; a < 3; a++) {
+				mesh.vertices[g * 3 + a] = part.mesh.vertices[v * 3 + a];
+			}
+		}
+		for (unsigned int index : part.mesh.indices) {
+			mesh.indices.push_back(remap[index]);
+		}
+	}
+
+	return mesh;
+}
+
+// write a partial mesh as: magic, vertex count, index count, ids, vertices, indices
+static bool write_partial_mesh(const PartialMesh& part, const std::string& fileName)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+	uint64_t counts[2] = { part.vertexIds.size(), part.mesh.indices.size() };
+	file.write(PARTIAL_MESH_MAGIC, sizeof(PARTIAL_MESH_MAGIC));
+	file.write((const char*)counts, sizeof(counts));
+	file.write((const char*)part.vertexIds.data(), part.vertexIds.size() * sizeof(uint64_t));
+	file.write((const char*)part.mesh.vertices.data(), part.mesh.vertices.size() * sizeof(float));
+	file.write((const char*)part.mesh.indices.data(), part.mesh.indices.size() * sizeof(unsigned int));
+	return (bool)file;
+}
+
+// read a partial mesh written by write_partial_mesh, returns false if the file is missing, foreign or truncated
+static bool read_partial_mesh(const std::string& fileName, PartialMesh& part)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	char magic[sizeof(PARTIAL_MESH_MAGIC)];
+	uint64_t counts[2];
+	if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, PARTIAL_MESH_MAGIC, sizeof(magic)) != 0) {
+		return false;
+	}
+	if (!file.read((char*)counts, sizeof(counts))) {
+		return false;
+	}
+
+	// compare the counts against the file size before allocating anything
+	std::streamoff start = file.tellg();
+	file.seekg(0, std::ios::end);
+	uint64_t payload = (uint64_t)(file.tellg() - start);
+	file.seekg(start);
+	if (counts[0] > payload / sizeof(uint64_t) || counts[1] > payload / sizeof(unsigned int) ||
+		counts[0] * (sizeof(uint64_t) + 3 * sizeof(float)) + counts[1] * sizeof(unsigned int) != payload) {
+		return false;
+	}
+
+	part.vertexIds.resize(counts[0]);
+	part.mesh.vertices.resize(counts[0] * 3);
+	part.mesh.indices.resize(counts[1]);
+	file.read((char*)part.vertexIds.data(), part.vertexIds.size() * sizeof(uint64_t));
+	file.read((char*)part.mesh.vertices.data(), part.mesh.vertices.size() * sizeof(float));
+	file.read((char*)part.mesh.indices.data(), part.mesh.indices.size() * sizeof(unsigned int));
+	if (!file) {
+		return false;
+	}
+
+	// indices must refer to vertices of this part
+	for (unsigned int index : part.mesh.indices) {
+		if (index >= counts[0]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// worker side of marching_cubes_partitioned: read a job file, extract its box and write the partial mesh it names
+bool run_partition_job(const std::string& jobFile)
+{
+	// job files hold the expression on the first line, then iso value, min and step size, the box, the ambiguity
+	// flag and the number of threads this worker may use, and the output file
+	std::ifstream job(jobFile);
+	std::string expression, outputFile;
+	float isoValue, min, stepSize;
+	PartitionBox box;
+	int resolveAmbiguity, workers;
+	std::getline(job, expression);
+	job >> isoValue >> min >> stepSize;
+	for (int a = 0; a < 3; a++) {
+		job >> box.cellBegin[a] >> box.cellEnd[a];
+	}
+	job >> resolveAmbiguity >> workers;
+	job.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+	std::getline(job, outputFile);
+	if (!job || outputFile.empty()) {
+		std::cerr << "Invalid partition job " << jobFile << std::endl;
+		return false;
+	}
+
+	CompiledField field;
+	std::string error;
+	if (!compile_field(expression, field, error)) {
+		std::cerr << "Invalid expression in " << jobFile << ": " << error << std::endl;
+		return false;
+	}
+
+	// the workers running at the same time share the machine's threads between them
+	set_worker_count(workers);
+	PartialMesh part = extract_partition(field, isoValue, min, stepSize, box, resolveAmbiguity != 0);
+	if (!write_partial_mesh(part, outputFile)) {
+		std::cerr << "Error writing " << outputFile << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// run `executable --partition-worker jobFile` and wait for it, without a shell so no character in the paths is
+// interpreted, returns true if it exited with status 0
+static bool run_worker_process(const std::string& executable, const std::string& jobFile)
+{
+#ifdef _WIN32
+	// windows paths cannot contain quotes, so quoting each argument is enough for the child's argument parser
+	std::string commandLine = "\"" + executable + "\" --partition-worker \"" + jobFile + "\"";
+	STARTUPINFOA startup = {};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION process = {};
+	if (!CreateProcessA(executable.c_str(), &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process)) {
+		return false;
+	}
+	WaitForSingleObject(process.hProcess, INFINITE);
+	DWORD status = 1;
+	GetExitCodeProcess(process.hProcess, &status);
+	CloseHandle(process.hThread);
+	CloseHandle(process.hProcess);
+	return status == 0;
+#else
+	std::string flag = "--partition-worker";
+	char* arguments[] = { (char*)executable.c_str(), &flag[0], (char*)jobFile.c_str(), nullptr };
+	pid_t child;
+	// like the shell, an executable name without a slash is looked up on PATH
+	if (posix_spawnp(&child, executable.c_str(), nullptr, nullptr, arguments, environ) != 0) {
+		return false;
+	}
+	int status;
+	while (waitpid(child, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+// prefix for the files of one run, unique across processes (pid) and across runs in this process (counter)
+static std::string unique_work_prefix(const std::string& workPrefix)
+{
+	static std::atomic<int> runs(0);
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = (int)getpid();
+#endif
+	return workPrefix + "_" + std::to_string(pid) + "_" + std::to_string(runs++);
+}
+
+// extract a compiled field with each partition in its own worker process, then merge the partial meshes
+bool marching_cubes_partitioned(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int partitionsPerAxis,
+	int maxProcesses,
+	const std::string& workerExecutable,
+	const std::string& workPrefix,
+	bool resolveAmbiguity,
+	Mesh& mesh,
+	std::string& error)
+{
+	std::vector<PartitionBox> boxes = partition_domain(min, max, stepSize, partitionsPerAxis);
+	int count = (int)boxes.size();
+	int processes = std::max(1, std::min(maxProcesses, count));
+	// the processes running at once split this machine's threads, so together they start about one per core
+	int workersPerProcess = std::max(1, worker_count() / processes);
+
+	std::string runPrefix = unique_work_prefix(workPrefix);
+	std::vector<std::string> jobFiles(count), meshFiles(count);
+	for (int p = 0; p < count; p++) {
+		jobFiles[p] = runPrefix + "_" + std::to_string(p) + ".job";
+		meshFiles[p] = runPrefix + "_" + std::to_string(p) + ".mesh";
+	}
+	// every exit path removes whatever files of this run exist
+	auto removeWorkFiles = [&]() {
+		for (int p = 0; p < count; p++) {
+			std::remove(jobFiles[p].c_str());
+			std::remove(meshFiles[p].c_str());
+		}
+	};
+
+	// write every job up front
+	for (int p = 0; p < count; p++) {
+		std::ofstream job(jobFiles[p]);
+		// enough digits for the floats to read back exactly
+		job << field.source << "\n" << std::setprecision(9) << isoValue << " " << min << " " << stepSize << "\n";
+		for (int a = 0; a < 3; a++) {
+			job << boxes[p].cellBegin[a] << " " << boxes[p].cellEnd[a] << " ";
+		}
+		job << "\n" << (resolveAmbiguity ? 1 : 0) << " " << workersPerProcess << "\n" << meshFiles[p] << "\n";
+		job.close();
+		if (!job) {
+			error = "could not write " + jobFiles[p];
+			removeWorkFiles();
+			return false;
+		}
+	}
+
+	// each launcher thread waits on one worker process at a time and takes the next job when it exits
+	std::vector<char> succeeded(count, 0);
+	std::atomic<int> next(0);
+	std::vector<std::thread> launchers;
+	for (int t = 0; t < processes; t++) {
+		launchers.emplace_back([&]() {
+			for (int p = next++; p < count; p = next++) {
+				succeeded[p] = run_worker_process(workerExecutable, jobFiles[p]);
+			}
+		});
+	}
+	for (std::thread& launcher : launchers) {
+		launcher.join();
+	}
+
+	// read back the partial meshes in partition order so the result does not depend on scheduling
+	std::vector<PartialMesh> parts(count);
+	bool ok = true;
+	for (int p = 0; p < count && ok; p++) {
+		if (!succeeded[p]) {
+			error = "worker for " + jobFiles[p] + " failed";
+			ok = false;
+		}
+		else if (!read_partial_mesh(meshFiles[p], parts[p])) {
+			error = "invalid partial mesh " + meshFiles[p];
+			ok = false;
+		}
+	}
+
+	removeWorkFiles();
+
+	if (ok) {
+		mesh = merge_partitions(parts);
+	}
+	return ok;
+}
@@ -0,0 +1,217 @@
+#include "../include/Pipeline.h"
+#include "../include/BoundedQueue.h"
+#include "../include/ScalarGrid.h"
+#include "../include/MarchingCubes.h"
+#include "../include/ComputeNormals.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+// triangles of one slab travelling down the pipeline, the last item has done set and no triangles
+struct PipelineSlab {
+	std::vector<float> vertices;
+	std::vector<float> normals;
+	bool done = false;
+};
+
+// seconds since start
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// write a count into a fixed width field so it can be patched once the real value is known
+static void write_count(std::ostream& file, size_t count)
+{
+	file << std::left << std::setw(20) << count << std::right;
+}
+
+// append the decimal digits of value to buffer
+static void append_number(std::string& buffer, size_t value)
+{
+	char digits[20];
+	int n = 0;
+	do {
+		digits[n++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (n > 0) {
+		buffer.push_back(digits[--n]);
+	}
+}
+
+// run the pipeline with sampleSlab(firstPlane, lastPlane) producing the samples of each slab
+static PipelineStats run_pipeline(
+	const std::function<ScalarGrid(int, int)>& sampleSlab,
+	float isoVal,
+	float min,
+	float max,
+	float stepSize,
+	const std::string& fileName,
+	int slabCells,
+	int queueDepth,
+	bool resolveAmbiguity)
+{
+	auto start = std::chrono::steady_clock::now();
+	PipelineStats stats = {};
+
+	std::ofstream file(fileName + ".ply");
+	if (!file) {
+		std::cerr << "Error creating file!" << std::endl;
+		return stats;
+	}
+
+	int cells = cell_count(min, max, stepSize);
+	slabCells = std::max(1, slabCells);
+	queueDepth = std::max(1, queueDepth);
+	stats.slabs = (cells + slabCells - 1) / slabCells;
+
+	BoundedQueue<PipelineSlab> extracted(queueDepth);
+	BoundedQueue<PipelineSlab> shaded(queueDepth);
+
+	// stage 1: neighbouring slabs share their boundary plane, so every cell is extracted exactly once and the
+	// slabs come out in the same order as a whole grid run
+	std::thread extractor([&]() {
+		for (int first = 0; first < cells; first += slabCells) {
+			auto busy = std::chrono::steady_clock::now();
+			PipelineSlab slab;
+			ScalarGrid grid = sampleSlab(first, std::min(first + slabCells, cells));
+			slab.vertices = marching_cubes(grid, isoVal, resolveAmbiguity);
+			stats.extractSeconds += seconds_since(busy);
+			extracted.push(std::move(slab));
+		}
+		PipelineSlab last;
+		last.done = true;
+		extracted.push(std::move(last));
+	});
+
+	// stage 2
+	std::thread shader([&]() {
+		for (;;) {
+			PipelineSlab slab = extracted.pop();
+			if (!slab.done) {
+				auto busy = std::chrono::steady_clock::now();
+				slab.normals = compute_normals(slab.vertices);
+				stats.normalSeconds += seconds_since(busy);
+			}
+			bool done = slab.done;
+			shaded.push(std::move(slab));
+			if (done) {
+				break;
+			}
+		}
+	});
+
+	// stage 3 runs on the calling thread, the header is written with placeholder counts that are patched at the end
+	file << "ply" << std::endl;
+	file << "format ascii 1.0" << std::endl;
+	file << "element vertex ";
+	std::streampos vertexCountPos = file.tellp();
+	write_count(file, 0);
+	file << std::endl;
+	file << "property float x" << std::endl;
+	file << "property float y" << std::endl;
+	file << "property float z" << std::endl;
+	file << "property float nx" << std::endl;
+	file << "property float ny" << std::endl;
+	file << "property float nz" << std::endl;
+	file << "element face ";
+	std::streampos faceCountPos = file.tellp();
+	write_count(file, 0);
+	file << std::endl;
+	file << "property list uchar uint vertex_indices" << std::endl;
+	file << "end_header" << std::endl;
+
+	size_t vertexCount = 0;
+	for (;;) {
+		PipelineSlab slab = shaded.pop();
+		if (slab.done) {
+			break;
+		}
+		// lines end in a plain newline rather than std::endl, flushing every line would make this the slowest stage
+		auto busy = std::chrono::steady_clock::now();
+		const std::vector<float>& vertices = slab.vertices;
+		const std::vector<float>& normals = slab.normals;
+		for (size_t i = 0; i < vertices.size(); i += 3) {
+			file << vertices[i] << " " << vertices[i + 1] << " " << vertices[i + 2] << " "
+				<< normals[i] << " " << normals[i + 1] << " " << normals[i + 2] << "\n";
+		}
+		vertexCount += vertices.size() / 3;
+		stats.writeSeconds += seconds_since(busy);
+	}
+
+	extractor.join();
+	shader.join();
+
+	// faces can only follow once every vertex is written, they are formatted by hand into large blocks as this part
+	// cannot overlap with the other stages
+	auto busy = std::chrono::steady_clock::now();
+	std::string faces;
+	const size_t block = 1 << 20;
+	faces.reserve(block + 64);
+	for (size_t i = 0; i < vertexCount; i += 3) {
+		faces += "3 ";
+		append_number(faces, i);
+		faces.push_back(' ');
+		append_number(faces, i + 1);
+		faces.push_back(' ');
+		append_number(faces, i + 2);
+		faces.push_back('\n');
+		if (faces.size() >= block) {
+			file.write(faces.data(), faces.size());
+			faces.clear();
+		}
+	}
+	file.write(faces.data(), faces.size());
+	file.seekp(vertexCountPos);
+	write_count(file, vertexCount);
+	file.seekp(faceCountPos);
+	write_count(file, vertexCount / 3);
+	file.close();
+	stats.writeSeconds += seconds_since(busy);
+
+	stats.triangles = vertexCount / 3;
+	stats.seconds = seconds_since(start);
+
+	std::cout << fileName << ".ply written successfully!" << std::endl;
+	return stats;
+}
+
+// sample, extract, compute normals for and write f as fileName.ply one x slab of slabCells cells at a time
+PipelineStats write_ply_pipelined(
+	std::function<float(float, float, float)> f,
+	float isoVal,
+	float min,
+	float max,
+	float stepSize,
+	std::string fileName,
+	int slabCells,
+	int queueDepth,
+	bool resolveAmbiguity)
+{
+	return run_pipeline([&](int firstPlane, int lastPlane) {
+		return sample_slab(f, min, max, stepSize, firstPlane, lastPlane);
+	}, isoVal, min, max, stepSize, fileName, slabCells, queueDepth, resolveAmbiguity);
+}
+
+// same as above for a compiled field
+PipelineStats write_ply_pipelined(
+	const CompiledField& field,
+	float isoVal,
+	float min,
+	float max,
+	float stepSize,
+	std::string fileName,
+	int slabCells,
+	int queueDepth,
+	bool resolveAmbiguity)
+{
+	return run_pipeline([&](int firstPlane, int lastPlane) {
+		return sample_slab(field, min, max, stepSize, firstPlane, lastPlane);
+	}, isoVal, min, max, stepSize, fileName, slabCells, queueDepth, resolveAmbiguity);
+}
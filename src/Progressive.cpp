@@ -0,0 +1,133 @@
+#include "../include/Progressive.h"
+#include "../include/ScalarGrid.h"
+#include "../include/MarchingCubes.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+
+// evaluates the field at count points given as separate x, y and z arrays
+typedef std::function<void(const float* x, const float* y, const float* z, float* out, size_t count)> PointSampler;
+
+// run the passes with sampler evaluating the field
+static ProgressiveStats run_progressive(
+	const PointSampler& sampler,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	const std::function<bool(const ProgressivePass&)>& onPass,
+	int coarseFactor,
+	bool resolveAmbiguity)
+{
+	auto start = std::chrono::steady_clock::now();
+	ProgressiveStats stats = {};
+
+	// the factor is halved every pass, so it has to be a power of two
+	int factor = 1;
+	while (factor * 2 <= coarseFactor) {
+		factor *= 2;
+	}
+	int cells = cell_count(min, max, stepSize);
+
+	ScalarGrid previous;
+	for (int pass = 0; factor >= 1; pass++, factor /= 2) {
+		// sample i of this pass is sample i * factor of the final lattice, and sample i / 2 of the previous pass if
+		// i is even along all three axes
+		ScalarGrid grid;
+		int samples = cells / factor + 1;
+		grid.dims[0] = grid.dims[1] = grid.dims[2] = samples;
+		grid.origin[0] = grid.origin[1] = grid.origin[2] = min;
+		grid.offset[0] = grid.offset[1] = grid.offset[2] = 0;
+		grid.stepSize = stepSize * factor;
+		grid.values.resize((size_t)samples * samples * samples);
+
+		int workers = worker_count();
+		std::vector<size_t> evaluated(workers, 0);
+		parallel_for(0, samples, [&](int begin, int end, int worker) {
+			std::vector<float> xs(samples), ys(samples), zs(samples), out(samples);
+			std::vector<int> ks(samples);
+			for (int i = begin; i < end; i++) {
+				for (int j = 0; j < samples; j++) {
+					// rows in odd planes are all new, rows in even planes only at odd k
+					bool evenRow = pass > 0 && i % 2 == 0 && j % 2 == 0;
+					size_t count = 0;
+					for (int k = 0; k < samples; k++) {
+						if (evenRow && k % 2 == 0) {
+							grid.values[grid.index(i, j, k)] = previous.values[previous.index(i / 2, j / 2, k / 2)];
+							continue;
+						}
+						// computed as on the final lattice, so the samples match sample_grid exactly
+						xs[count] = min + (float)(i * factor) * stepSize;
+						ys[count] = min + (float)(j * factor) * stepSize;
+						zs[count] = min + (float)(k * factor) * stepSize;
+						ks[count] = k;
+						count++;
+					}
+					sampler(xs.data(), ys.data(), zs.data(), out.data(), count);
+					for (size_t n = 0; n < count; n++) {
+						grid.values[grid.index(i, j, ks[n])] = out[n];
+					}
+					evaluated[worker] += count;
+				}
+			}
+		});
+		for (size_t count : evaluated) {
+			stats.samplesEvaluated += count;
+		}
+
+		ProgressivePass result;
+		result.pass = pass;
+		result.stepSize = grid.stepSize;
+		result.vertices = marching_cubes(grid, isoValue, resolveAmbiguity);
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.final = factor == 1;
+
+		if (pass == 0) {
+			stats.timeToFirstMesh = result.seconds;
+		}
+		stats.seconds = result.seconds;
+		stats.passes++;
+		if (!onPass(result) && !result.final) {
+			stats.cancelled = true;
+			break;
+		}
+		previous = std::move(grid);
+	}
+
+	return stats;
+}
+
+// marching cubes at coarseFactor times the step first, then refining until the requested step is reached
+ProgressiveStats marching_cubes_progressive(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	const std::function<bool(const ProgressivePass&)>& onPass,
+	int coarseFactor,
+	bool resolveAmbiguity)
+{
+	return run_progressive([&](const float* x, const float* y, const float* z, float* out, size_t count) {
+		for (size_t n = 0; n < count; n++) {
+			out[n] = f(x[n], y[n], z[n]);
+		}
+	}, isoValue, min, max, stepSize, onPass, coarseFactor, resolveAmbiguity);
+}
+
+// same as above for a compiled field
+ProgressiveStats marching_cubes_progressive(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	const std::function<bool(const ProgressivePass&)>& onPass,
+	int coarseFactor,
+	bool resolveAmbiguity)
+{
+	return run_progressive([&](const float* x, const float* y, const float* z, float* out, size_t count) {
+		evaluate_field_row(field, x, y, z, out, count);
+	}, isoValue, min, max, stepSize, onPass, coarseFactor, resolveAmbiguity);
+}
@@ -0,0 +1,161 @@
+#include "../include/ScalarGrid.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+// number of cells needed to cover [min, max] with the given step size
+int cell_count(float min, float max, float stepSize) {
+	// the small tolerance keeps an exact multiple of stepSize from growing an extra cell due to rounding
+	return std::max(1, (int)std::ceil((max - min) / stepSize - 1e-4f));
+}
+
+// allocate the samples [sampleBegin, sampleEnd] of the lattice starting at (min, min, min)
+static ScalarGrid allocate_box(float min, float stepSize, const int sampleBegin[3], const int sampleEnd[3])
+{
+	ScalarGrid grid;
+	for (int a = 0; a < 3; a++) {
+		grid.dims[a] = sampleEnd[a] - sampleBegin[a] + 1;
+		grid.origin[a] = min;
+		grid.offset[a] = sampleBegin[a];
+	}
+	grid.stepSize = stepSize;
+	grid.values.resize((size_t)grid.dims[0] * grid.dims[1] * grid.dims[2]);
+	return grid;
+}
+
+// sample f on the lattice covering the cube [min, max]^3
+ScalarGrid sample_grid(
+	std::function<float(float, float, float)> f,
+	float min,
+	float max,
+	float stepSize)
+{
+	return sample_slab(f, min, max, stepSize, 0, cell_count(min, max, stepSize));
+}
+
+// sample a compiled field on the lattice covering the cube [min, max]^3, a whole row of z samples per evaluation
+ScalarGrid sample_grid(
+	const CompiledField& field,
+	float min,
+	float max,
+	float stepSize)
+{
+	return sample_slab(field, min, max, stepSize, 0, cell_count(min, max, stepSize));
+}
+
+// sample only the x planes [firstPlane, lastPlane] of the lattice covering the cube [min, max]^3
+ScalarGrid sample_slab(
+	std::function<float(float, float, float)> f,
+	float min,
+	float max,
+	float stepSize,
+	int firstPlane,
+	int lastPlane)
+{
+	int last = cell_count(min, max, stepSize);
+	int sampleBegin[3] = { firstPlane, 0, 0 };
+	int sampleEnd[3] = { lastPlane, last, last };
+	return sample_box(f, min, stepSize, sampleBegin, sampleEnd);
+}
+
+// sample only the x planes [firstPlane, lastPlane] of the lattice covering the cube [min, max]^3
+ScalarGrid sample_slab(
+	const CompiledField& field,
+	float min,
+	float max,
+	float stepSize,
+	int firstPlane,
+	int lastPlane)
+{
+	int last = cell_count(min, max, stepSize);
+	int sampleBegin[3] = { firstPlane, 0, 0 };
+	int sampleEnd[3] = { lastPlane, last, last };
+	return sample_box(field, min, stepSize, sampleBegin, sampleEnd);
+}
+
+// sample only the samples [sampleBegin, sampleEnd] (inclusive lattice indices) of the lattice starting at (min, min, min)
+ScalarGrid sample_box(
+	std::function<float(float, float, float)> f,
+	float min,
+	float stepSize,
+	const int sampleBegin[3],
+	const int sampleEnd[3])
+{
+	ScalarGrid grid = allocate_box(min, stepSize, sampleBegin, sampleEnd);
+
+	// every x plane is independent, so split them across the workers
+	parallel_for(0, grid.dims[0], [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++) {
+			float x = grid.position(0, (float)i);
+			for (int j = 0; j < grid.dims[1]; j++) {
+				float y = grid.position(1, (float)j);
+				for (int k = 0; k < grid.dims[2]; k++) {
+					float z = grid.position(2, (float)k);
+					grid.values[grid.index(i, j, k)] = f(x, y, z);
+				}
+			}
+		}
+	});
+
+	return grid;
+}
+
+// sample only the samples [sampleBegin, sampleEnd] (inclusive lattice indices) of the lattice starting at (min, min, min)
+ScalarGrid sample_box(
+	const CompiledField& field,
+	float min,
+	float stepSize,
+	const int sampleBegin[3],
+	const int sampleEnd[3])
+{
+	ScalarGrid grid = allocate_box(min, stepSize, sampleBegin, sampleEnd);
+	int samples = grid.dims[2];
+
+	// z coordinates are the same for every row
+	std::vector<float> zs(samples);
+	for (int k = 0; k < samples; k++) {
+		zs[k] = grid.position(2, (float)k);
+	}
+
+	parallel_for(0, grid.dims[0], [&](int begin, int end, int) {
+		std::vector<float> xs(samples), ys(samples);
+		for (int i = begin; i < end; i++) {
+			std::fill(xs.begin(), xs.end(), grid.position(0, (float)i));
+			for (int j = 0; j < grid.dims[1]; j++) {
+				std::fill(ys.begin(), ys.end(), grid.position(1, (float)j));
+				// rows along z are contiguous in the grid, so they are written in place
+				evaluate_field_row(field, xs.data(), ys.data(), zs.data(), &grid.values[grid.index(i, j, 0)], samples);
+			}
+		}
+	});
+
+	return grid;
+}
+
+// keep every factor-th sample of a grid along each axis, the result covers the same origin with factor times the step
+ScalarGrid subsample_grid(const ScalarGrid& grid, int factor)
+{
+	ScalarGrid coarse;
+	for (int a = 0; a < 3; a++) {
+		// trailing samples that do not complete a coarse cell are dropped
+		coarse.dims[a] = (grid.dims[a] - 1) / factor + 1;
+		// an offset that is not a multiple of factor is moved into the origin
+		coarse.offset[a] = grid.offset[a] / factor;
+		coarse.origin[a] = grid.origin[a] + (grid.offset[a] - coarse.offset[a] * factor) * grid.stepSize;
+	}
+	coarse.stepSize = grid.stepSize * factor;
+	coarse.values.resize((size_t)coarse.dims[0] * coarse.dims[1] * coarse.dims[2]);
+
+	parallel_for(0, coarse.dims[0], [&](int begin, int end, int) {
+		for (int i = begin; i < end; i++) {
+			for (int j = 0; j < coarse.dims[1]; j++) {
+				for (int k = 0; k < coarse.dims[2]; k++) {
+					coarse.values[coarse.index(i, j, k)] = grid.values[grid.index(i * factor, j * factor, k * factor)];
+				}
+			}
+		}
+	});
+
+	return coarse;
+}
@@ -0,0 +1,296 @@
+#include "../include/Sequence.h"
+#include "../include/MarchingCubes.h"
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+// first bytes of a sequence file
+static const char SEQUENCE_MAGIC[8] = { 'M', 'C', 'S', 'E', 'Q', '0', '0', '2' };
+
+// start a sequence, bricks are blocks of brickCells^3 cells
+SequenceExtractor make_sequence_extractor(float isoValue, int brickCells, bool resolveAmbiguity)
+{
+	SequenceExtractor sequence;
+	sequence.isoValue = isoValue;
+	sequence.brickCells = std::max(1, brickCells);
+	sequence.previousBrickCells = sequence.brickCells;
+	sequence.resolveAmbiguity = resolveAmbiguity;
+	return sequence;
+}
+
+// true if no sample of a brick moved to the other side of the isovalue since the previous frame (or changed at all
+// when resolving ambiguity, as the asymptotic decider depends on the values themselves)
+static bool same_sides(const SequenceExtractor& sequence, const ScalarGrid& grid, const MeshChunk& brick)
+{
+	float iso = sequence.isoValue;
+	for (int i = brick.cellBegin[0]; i <= brick.cellEnd[0]; i++) {
+		for (int j = brick.cellBegin[1]; j <= brick.cellEnd[1]; j++) {
+			size_t row = grid.index(i, j, 0);
+			for (int k = brick.cellBegin[2]; k <= brick.cellEnd[2]; k++) {
+				float now = grid.values[row + k];
+				float before = sequence.previous.values[row + k];
+				if (sequence.resolveAmbiguity ? now != before : (now < iso) != (before < iso)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// true if two grids sample the same points, so their bricks line up sample for sample
+static bool same_lattice(const ScalarGrid& a, const ScalarGrid& b)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		if (a.dims[axis] != b.dims[axis] || a.origin[axis] != b.origin[axis] || a.offset[axis] != b.offset[axis]) {
+			return false;
+		}
+	}
+	return a.stepSize == b.stepSize;
+}
+
+// extract the next frame of a sequence from its samples
+ChunkedMesh extract_frame(SequenceExtractor& sequence, ScalarGrid grid, FrameStats& stats)
+{
+	ChunkedMesh chunked;
+	chunked.chunks = chunk_layout(grid, sequence.brickCells);
+	int bricks = (int)chunked.chunks.size();
+
+	bool first = sequence.previous.values.empty();
+	if (!first && (!same_lattice(sequence.previous, grid) || sequence.previousBrickCells != sequence.brickCells)) {
+		// a different lattice or brick size, start over
+		first = true;
+	}
+	if (first) {
+		sequence.brickMin.assign(bricks, 0.0f);
+		sequence.brickMax.assign(bricks, 0.0f);
+		sequence.brickVertices.assign(bricks, std::vector<float>());
+	}
+	sequence.brickChanged.assign(bricks, 0);
+
+	// counted per worker, then summed
+	int workers = worker_count();
+	std::vector<size_t> skipped(workers, 0), reused(workers, 0), extracted(workers, 0);
+
+	// the workers only read the samples, through a const reference so borrowed samples are never copied
+	const ScalarGrid& samples = grid;
+	parallel_for(0, bricks, [&](int begin, int end, int worker) {
+		for (int b = begin; b < end; b++) {
+			const MeshChunk& brick = chunked.chunks[b];
+			float iso = sequence.isoValue;
+
+			// a brick samples its cells' corners, including the planes it shares with the next bricks
+			float low = samples.values[samples.index(brick.cellBegin[0], brick.cellBegin[1], brick.cellBegin[2])];
+			float high = low;
+			for (int i = brick.cellBegin[0]; i <= brick.cellEnd[0]; i++) {
+				for (int j = brick.cellBegin[1]; j <= brick.cellEnd[1]; j++) {
+					for (int k = brick.cellBegin[2]; k <= brick.cellEnd[2]; k++) {
+						float value = samples.values[samples.index(i, j, k)];
+						low = std::min(low, value);
+						high = std::max(high, value);
+					}
+				}
+			}
+
+			if (high < iso || low >= iso) {
+				// entirely inside or entirely outside, so there are no triangles whatever the previous frame was
+				sequence.brickChanged[b] = !sequence.brickVertices[b].empty();
+				sequence.brickVertices[b].clear();
+				skipped[worker]++;
+			}
+			// a brick that was entirely on one side last frame and is not now has certainly changed, otherwise its
+			// samples are compared one by one
+			else if (!first && sequence.brickMin[b] < iso && sequence.brickMax[b] >= iso && same_sides(sequence, samples, brick)) {
+				reused[worker]++;
+			}
+			else {
+				sequence.brickVertices[b].clear();
+				marching_cubes_cells(samples, iso, brick.cellBegin, brick.cellEnd, sequence.resolveAmbiguity, sequence.brickVertices[b]);
+				sequence.brickChanged[b] = true;
+				extracted[worker]++;
+			}
+			sequence.brickMin[b] = low;
+			sequence.brickMax[b] = high;
+		}
+	});
+
+	stats.bricks = bricks;
+	stats.skippedBricks = stats.reusedBricks = stats.extractedBricks = 0;
+	for (int w = 0; w < workers; w++) {
+		stats.skippedBricks += skipped[w];
+		stats.reusedBricks += reused[w];
+		stats.extractedBricks += extracted[w];
+	}
+
+	place_chunks(sequence.brickVertices, chunked);
+	sequence.previous = std::move(grid);
+	sequence.previousBrickCells = sequence.brickCells;
+	return chunked;
+}
+
+// sample f(x, y, z, t) at t = 0, timeStep, 2 timeStep, ... over the cube [min, max]^3 and write the frames to fileName
+SequenceStats write_sequence(
+	std::function<float(float, float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int frames,
+	float timeStep,
+	std::string fileName,
+	int brickCells,
+	bool resolveAmbiguity)
+{
+	auto start = std::chrono::steady_clock::now();
+	SequenceStats stats = {};
+
+	// vertices are stored as 16 bit half step coordinates, which only reach 32767 cells
+	int cells = cell_count(min, max, stepSize);
+	if (cells > 32767) {
+		std::cerr << "Lattice too fine for a sequence file, at most 32767 cells per axis!" << std::endl;
+		return stats;
+	}
+	// the brick layout of chunk_layout, every brick index in the file is below brickCount
+	brickCells = std::max(1, brickCells);
+	uint64_t bricksPerAxis = (uint64_t)(cells + brickCells - 1) / brickCells;
+	if (bricksPerAxis * bricksPerAxis * bricksPerAxis > (uint64_t)std::numeric_limits<int>::max()) {
+		std::cerr << "Bricks too small for a sequence file, use larger bricks!" << std::endl;
+		return stats;
+	}
+	uint32_t brickCount = (uint32_t)(bricksPerAxis * bricksPerAxis * bricksPerAxis);
+
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file) {
+		std::cerr << "Error creating file!" << std::endl;
+		return stats;
+	}
+
+	// header: magic, lattice origin and step, the number of bricks, then the number of frames, patched at the end
+	uint32_t frameCount = 0;
+	file.write(SEQUENCE_MAGIC, sizeof(SEQUENCE_MAGIC));
+	file.write((const char*)&min, sizeof(float));
+	file.write((const char*)&stepSize, sizeof(float));
+	file.write((const char*)&brickCount, sizeof(brickCount));
+	std::streampos frameCountPos = file.tellp();
+	file.write((const char*)&frameCount, sizeof(frameCount));
+
+	SequenceExtractor sequence = make_sequence_extractor(isoValue, brickCells, resolveAmbiguity);
+	std::vector<uint16_t> coordinates;
+	for (int frame = 0; frame < frames; frame++) {
+		float t = frame * timeStep;
+		ScalarGrid grid = sample_grid([&](float x, float y, float z) { return f(x, y, z, t); }, min, max, stepSize);
+		FrameStats frameStats;
+		extract_frame(sequence, std::move(grid), frameStats);
+		stats.reusedBricks += frameStats.reusedBricks;
+		stats.extractedBricks += frameStats.extractedBricks;
+
+		// frame: number of changed bricks, then for each its index, vertex count and coordinates
+		uint32_t changed = 0;
+		for (unsigned char c : sequence.brickChanged) {
+			changed += c;
+		}
+		file.write((const char*)&changed, sizeof(changed));
+		for (size_t b = 0; b < sequence.brickChanged.size(); b++) {
+			if (!sequence.brickChanged[b]) {
+				continue;
+			}
+			const std::vector<float>& vertices = sequence.brickVertices[b];
+			// every vertex lies on a lattice point, edge midpoint or cube centre, i.e. a whole number of half steps
+			coordinates.resize(vertices.size());
+			for (size_t v = 0; v < vertices.size(); v++) {
+				coordinates[v] = (uint16_t)std::lround((vertices[v] - min) / stepSize * 2.0f);
+			}
+			uint32_t header[2] = { (uint32_t)b, (uint32_t)(vertices.size() / 3) };
+			file.write((const char*)header, sizeof(header));
+			file.write((const char*)coordinates.data(), coordinates.size() * sizeof(uint16_t));
+		}
+		frameCount++;
+	}
+
+	file.seekp(frameCountPos);
+	file.write((const char*)&frameCount, sizeof(frameCount));
+	file.seekp(0, std::ios::end);
+	stats.bytes = (size_t)file.tellp();
+	file.close();
+
+	stats.frames = frames;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.framesPerSecond = stats.seconds > 0.0 ? frames / stats.seconds : 0.0;
+
+	std::cout << fileName << " written successfully!" << std::endl;
+	return stats;
+}
+
+// read a file written by write_sequence, calling onFrame with the triangle vertices of every frame in turn
+bool read_sequence(const std::string& fileName, const std::function<void(int, const std::vector<float>&)>& onFrame)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	char magic[sizeof(SEQUENCE_MAGIC)];
+	float min, stepSize;
+	uint32_t brickCount, frameCount;
+	if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, SEQUENCE_MAGIC, sizeof(magic)) != 0) {
+		return false;
+	}
+	file.read((char*)&min, sizeof(float));
+	file.read((char*)&stepSize, sizeof(float));
+	file.read((char*)&brickCount, sizeof(brickCount));
+	file.read((char*)&frameCount, sizeof(frameCount));
+	if (!file) {
+		return false;
+	}
+
+	// vertex counts are compared against the bytes left before allocating anything
+	std::streamoff position = file.tellg();
+	file.seekg(0, std::ios::end);
+	uint64_t remaining = (uint64_t)(file.tellg() - position);
+	file.seekg(position);
+
+	// the triangles of every brick seen so far, bricks missing from a frame keep their previous triangles
+	std::vector<std::vector<float>> brickVertices;
+	std::vector<uint16_t> coordinates;
+	std::vector<float> vertices;
+	for (uint32_t frame = 0; frame < frameCount; frame++) {
+		uint32_t changed;
+		if (!file.read((char*)&changed, sizeof(changed))) {
+			return false;
+		}
+		remaining -= sizeof(changed);
+		for (uint32_t c = 0; c < changed; c++) {
+			uint32_t header[2];
+			if (!file.read((char*)header, sizeof(header))) {
+				return false;
+			}
+			remaining -= sizeof(header);
+			if (header[0] >= brickCount || header[1] > remaining / (3 * sizeof(uint16_t))) {
+				return false;
+			}
+			remaining -= (uint64_t)header[1] * 3 * sizeof(uint16_t);
+			if (header[0] >= brickVertices.size()) {
+				brickVertices.resize(header[0] + 1);
+			}
+			coordinates.resize((size_t)header[1] * 3);
+			if (!file.read((char*)coordinates.data(), coordinates.size() * sizeof(uint16_t))) {
+				return false;
+			}
+			// the same expression as ScalarGrid::position, so the vertices come back bit for bit
+			std::vector<float>& brick = brickVertices[header[0]];
+			brick.resize(coordinates.size());
+			for (size_t v = 0; v < coordinates.size(); v++) {
+				brick[v] = min + (coordinates[v] * 0.5f) * stepSize;
+			}
+		}
+
+		vertices.clear();
+		for (const std::vector<float>& brick : brickVertices) {
+			vertices.insert(vertices.end(), brick.begin(), brick.end());
+		}
+		onFrame((int)frame, vertices);
+	}
+	return true;
+}
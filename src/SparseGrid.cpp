@@ -0,0 +1,261 @@
+#include "../include/SparseGrid.h"
+#include "../include/ScalarGrid.h"
+#include "../include/Parallel.h"
+#include "../include/MarchingCubes.h"
+
+#include <algorithm>
+#include <cstring>
+
+// evaluates the samples [begin, begin + size) of the lattice into out, x-major
+typedef std::function<void(const int begin[3], const int size[3], float* out)> BlockSampler;
+
+// true if some cell of a box of size[0] x size[1] x size[2] samples has corners on both sides of the isovalue
+static bool has_crossing_cell(const float* values, const int size[3], float isoValue)
+{
+	for (int i = 0; i + 1 < size[0]; i++) {
+		for (int j = 0; j + 1 < size[1]; j++) {
+			for (int k = 0; k + 1 < size[2]; k++) {
+				int inside = 0;
+				for (int c = 0; c < 8; c++) {
+					int ci = i + (c & 1), cj = j + (c >> 1 & 1), ck = k + (c >> 2);
+					inside += values[((size_t)ci * size[1] + cj) * size[2] + ck] < isoValue;
+				}
+				if (inside != 0 && inside != 8) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// copy a box of samples into a leaf, which always has LEAF_SIZE samples per side
+static void fill_leaf(SparseLeaf& leaf, const float* values, const int size[3])
+{
+	std::fill(leaf.values, leaf.values + LEAF_SAMPLES, 0.0f);
+	for (int i = 0; i < std::min(size[0], LEAF_SIZE); i++) {
+		for (int j = 0; j < std::min(size[1], LEAF_SIZE); j++) {
+			std::memcpy(&leaf.values[(i * LEAF_SIZE + j) * LEAF_SIZE], &values[((size_t)i * size[1] + j) * size[2]],
+				std::min(size[2], LEAF_SIZE) * sizeof(float));
+		}
+	}
+}
+
+// build a sparse grid over the lattice covering [min, max]^3 with samples from sampler
+static SparseGrid build_sparse_grid(const BlockSampler& sampler, float isoValue, float min, float max, float stepSize, int bandBlocks)
+{
+	SparseGrid grid;
+	int samples = cell_count(min, max, stepSize) + 1;
+	for (int a = 0; a < 3; a++) {
+		grid.dims[a] = samples;
+		grid.origin[a] = min;
+		grid.blockDims[a] = (samples + LEAF_SIZE - 1) / LEAF_SIZE;
+	}
+	grid.stepSize = stepSize;
+	grid.isoValue = isoValue;
+	int blockCount = grid.blockDims[0] * grid.blockDims[1] * grid.blockDims[2];
+	grid.blocks.resize(blockCount);
+
+	auto blockCoords = [&](int b, int coords[3]) {
+		coords[0] = b / (grid.blockDims[1] * grid.blockDims[2]);
+		coords[1] = b / grid.blockDims[2] % grid.blockDims[1];
+		coords[2] = b % grid.blockDims[2];
+	};
+
+	// first pass: sample every block together with the planes it shares with its upper neighbours, so its own cells
+	// can be tested, and keep the blocks that own a crossing cell straight away
+	int workers = worker_count();
+	std::vector<std::vector<SparseLeaf>> ownedLeaves(workers);
+	std::vector<unsigned char> owns(blockCount, 0);
+	parallel_for(0, blockCount, [&](int begin, int end, int worker) {
+		std::vector<float> scratch((LEAF_SIZE + 1) * (LEAF_SIZE + 1) * (LEAF_SIZE + 1));
+		for (int b = begin; b < end; b++) {
+			int coords[3], first[3], size[3];
+			blockCoords(b, coords);
+			for (int a = 0; a < 3; a++) {
+				first[a] = coords[a] * LEAF_SIZE;
+				size[a] = std::min(LEAF_SIZE + 1, grid.dims[a] - first[a]);
+			}
+			sampler(first, size, scratch.data());
+
+			if (has_crossing_cell(scratch.data(), size, isoValue)) {
+				owns[b] = 1;
+				ownedLeaves[worker].emplace_back();
+				ownedLeaves[worker].back().block = b;
+				fill_leaf(ownedLeaves[worker].back(), scratch.data(), size);
+			}
+			// a block without crossing cells of its own has all its samples on one side, unless a crossing cell of a
+			// lower neighbour reaches into it, in which case it is activated below
+			grid.blocks[b].leaf = -1;
+			grid.blocks[b].tile = scratch[0];
+		}
+	});
+
+	// a block is active if it or a lower neighbour owns a crossing cell (the neighbour's cells end on this block's
+	// first planes), grown by bandBlocks rings
+	int reach = 1 + bandBlocks;
+	std::vector<unsigned char> active(blockCount, 0);
+	parallel_for(0, blockCount, [&](int begin, int end, int) {
+		for (int b = begin; b < end; b++) {
+			int coords[3];
+			blockCoords(b, coords);
+			int low[3], high[3];
+			for (int a = 0; a < 3; a++) {
+				low[a] = std::max(0, coords[a] - reach);
+				high[a] = std::min(grid.blockDims[a] - 1, coords[a] + bandBlocks);
+			}
+			for (int bi = low[0]; bi <= high[0] && !active[b]; bi++) {
+				for (int bj = low[1]; bj <= high[1] && !active[b]; bj++) {
+					for (int bk = low[2]; bk <= high[2]; bk++) {
+						if (owns[grid.blockIndex(bi, bj, bk)]) {
+							active[b] = 1;
+							break;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	// leaves are numbered in block order
+	int leafCount = 0;
+	for (int b = 0; b < blockCount; b++) {
+		if (active[b]) {
+			grid.blocks[b].leaf = leafCount++;
+		}
+	}
+	grid.leaves.resize(leafCount);
+	for (std::vector<SparseLeaf>& leaves : ownedLeaves) {
+		for (SparseLeaf& leaf : leaves) {
+			grid.leaves[grid.blocks[leaf.block].leaf] = leaf;
+		}
+		std::vector<SparseLeaf>().swap(leaves);
+	}
+
+	// second pass: sample the blocks that were only activated by their neighbours or the band
+	parallel_for(0, blockCount, [&](int begin, int end, int) {
+		std::vector<float> scratch(LEAF_SAMPLES);
+		for (int b = begin; b < end; b++) {
+			if (!active[b] || owns[b]) {
+				continue;
+			}
+			int coords[3], first[3], size[3];
+			blockCoords(b, coords);
+			for (int a = 0; a < 3; a++) {
+				first[a] = coords[a] * LEAF_SIZE;
+				size[a] = std::min(LEAF_SIZE, grid.dims[a] - first[a]);
+			}
+			sampler(first, size, scratch.data());
+			SparseLeaf& leaf = grid.leaves[grid.blocks[b].leaf];
+			leaf.block = b;
+			fill_leaf(leaf, scratch.data(), size);
+		}
+	});
+
+	return grid;
+}
+
+// sample f on the lattice covering the cube [min, max]^3, keeping only the blocks near the isosurface
+SparseGrid sample_sparse_grid(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int bandBlocks)
+{
+	// positions are computed as in ScalarGrid::position, so the samples match sample_grid exactly
+	return build_sparse_grid([&](const int begin[3], const int size[3], float* out) {
+		for (int i = 0; i < size[0]; i++) {
+			float x = min + (float)(begin[0] + i) * stepSize;
+			for (int j = 0; j < size[1]; j++) {
+				float y = min + (float)(begin[1] + j) * stepSize;
+				for (int k = 0; k < size[2]; k++) {
+					float z = min + (float)(begin[2] + k) * stepSize;
+					*out++ = f(x, y, z);
+				}
+			}
+		}
+	}, isoValue, min, max, stepSize, bandBlocks);
+}
+
+// sample a compiled field into a sparse grid
+SparseGrid sample_sparse_grid(
+	const CompiledField& field,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize,
+	int bandBlocks)
+{
+	return build_sparse_grid([&](const int begin[3], const int size[3], float* out) {
+		float xs[LEAF_SIZE + 1], ys[LEAF_SIZE + 1], zs[LEAF_SIZE + 1];
+		for (int k = 0; k < size[2]; k++) {
+			zs[k] = min + (float)(begin[2] + k) * stepSize;
+		}
+		for (int i = 0; i < size[0]; i++) {
+			std::fill(xs, xs + size[2], min + (float)(begin[0] + i) * stepSize);
+			for (int j = 0; j < size[1]; j++) {
+				std::fill(ys, ys + size[2], min + (float)(begin[1] + j) * stepSize);
+				evaluate_field_row(field, xs, ys, zs, out, size[2]);
+				out += size[2];
+			}
+		}
+	}, isoValue, min, max, stepSize, bandBlocks);
+}
+
+// memory held by a sparse grid in bytes
+size_t sparse_grid_bytes(const SparseGrid& grid)
+{
+	return sizeof(SparseGrid) + grid.blocks.capacity() * sizeof(SparseBlock) + grid.leaves.capacity() * sizeof(SparseLeaf);
+}
+
+// marching cubes over the active leaves of a sparse grid at the isovalue it was sampled for
+std::vector<float> marching_cubes_sparse(const SparseGrid& grid, bool resolveAmbiguity)
+{
+	int workers = worker_count();
+	std::vector<std::vector<float>> workerVertices(workers);
+
+	parallel_for(0, (int)grid.leaves.size(), [&](int begin, int end, int worker) {
+		// each leaf is copied with the first planes of its upper neighbours into a small dense grid, so the cells
+		// along its far faces read contiguous memory instead of looking up neighbouring leaves for every corner
+		ScalarGrid padded;
+		padded.origin[0] = grid.origin[0];
+		padded.origin[1] = grid.origin[1];
+		padded.origin[2] = grid.origin[2];
+		padded.stepSize = grid.stepSize;
+		padded.values.resize((LEAF_SIZE + 1) * (LEAF_SIZE + 1) * (LEAF_SIZE + 1));
+
+		for (int l = begin; l < end; l++) {
+			const SparseLeaf& leaf = grid.leaves[l];
+			int b = leaf.block;
+			int coords[3] = { b / (grid.blockDims[1] * grid.blockDims[2]), b / grid.blockDims[2] % grid.blockDims[1], b % grid.blockDims[2] };
+			int cellBegin[3] = { 0, 0, 0 };
+			int cellEnd[3];
+			for (int a = 0; a < 3; a++) {
+				padded.offset[a] = coords[a] * LEAF_SIZE;
+				padded.dims[a] = std::min(LEAF_SIZE + 1, grid.dims[a] - padded.offset[a]);
+				cellEnd[a] = padded.dims[a] - 1;
+			}
+
+			for (int i = 0; i < padded.dims[0]; i++) {
+				for (int j = 0; j < padded.dims[1]; j++) {
+					for (int k = 0; k < padded.dims[2]; k++) {
+						padded.values[padded.index(i, j, k)] = i < LEAF_SIZE && j < LEAF_SIZE && k < LEAF_SIZE
+							? leaf.values[(i * LEAF_SIZE + j) * LEAF_SIZE + k]
+							: grid.value(padded.offset[0] + i, padded.offset[1] + j, padded.offset[2] + k);
+					}
+				}
+			}
+
+			marching_cubes_cells(padded, grid.isoValue, cellBegin, cellEnd, resolveAmbiguity, workerVertices[worker]);
+		}
+	});
+
+	// workers hold consecutive runs of leaves, so joining them keeps the leaf order
+	std::vector<float> vertices;
+	for (const std::vector<float>& list : workerVertices) {
+		vertices.insert(vertices.end(), list.begin(), list.end());
+	}
+	return vertices;
+}
@@ -0,0 +1,156 @@
+#include "../include/SurfaceNets.h"
+#include "../include/Parallel.h"
+#include "../include/TriTable.h"
+
+// surface nets extraction, places one vertex per cell crossed by the surface and joins them with quads (2 triangles each)
+Mesh surface_nets(
+	std::function<float(float, float, float)> f,
+	float isoValue,
+	float min,
+	float max,
+	float stepSize)
+{
+	// sample the scalar field once at every lattice point, then extract from the samples
+	return surface_nets(sample_grid(f, min, max, stepSize), isoValue);
+}
+
+// surface nets over a lattice that has already been sampled
+Mesh surface_nets(const ScalarGrid& grid, float isoValue)
+{
+	int cells[3] = { grid.dims[0] - 1, grid.dims[1] - 1, grid.dims[2] - 1 };
+
+	// index of the vertex placed in each cell, -1 when the surface does not cross the cell
+	std::vector<int> cellVertex((size_t)cells[0] * cells[1] * cells[2], -1);
+	auto cellIndex = [&](int i, int j, int k) {
+		return ((size_t)i * cells[1] + j) * cells[2] + k;
+	};
+
+	// first pass: every worker places the vertices of its own x slabs
+	int workers = worker_count();
+	std::vector<std::vector<float>> slabVertices(workers);
+
+	parallel_for(0, cells[0], [&](int begin, int end, int worker) {
+		std::vector<float>& vertices = slabVertices[worker];
+
+		for (int i = begin; i < end; i++) {
+			for (int j = 0; j < cells[1]; j++) {
+				for (int k = 0; k < cells[2]; k++) {
+
+					// look up the scalar field values of the cube's 8 vertices
+					float scalars[8];
+					int theCase = 0;
+					for (int c = 0; c < 8; c++) {
+						scalars[c] = grid.values[grid.index(i + cornerTable[c][0], j + cornerTable[c][1], k + cornerTable[c][2])];
+						if (scalars[c] < isoValue) {
+							theCase |= 1 << c;
+						}
+					}
+
+					// the surface does not pass through this cell
+					if (theCase == 0 || theCase == 255) {
+						continue;
+					}
+
+					// average the points where the surface crosses the cell's edges
+					float sum[3] = { 0.0f, 0.0f, 0.0f };
+					int crossings = 0;
+					for (int e = 0; e < 12; e++) {
+						int c0 = edgeCorners[e][0];
+						int c1 = edgeCorners[e][1];
+						if (((theCase >> c0) & 1) == ((theCase >> c1) & 1)) {
+							continue;
+						}
+						// linear interpolation of the crossing along the edge
+						float t = (isoValue - scalars[c0]) / (scalars[c1] - scalars[c0]);
+						for (int a = 0; a < 3; a++) {
+							sum[a] += cornerTable[c0][a] + t * (cornerTable[c1][a] - cornerTable[c0][a]);
+						}
+						crossings++;
+					}
+
+					// store the index local to this worker, it is offset once all workers have finished
+					cellVertex[cellIndex(i, j, k)] = (int)(vertices.size() / 3);
+					vertices.push_back(grid.position(0, i + sum[0] / crossings));
+					vertices.push_back(grid.position(1, j + sum[1] / crossings));
+					vertices.push_back(grid.position(2, k + sum[2] / crossings));
+				}
+			}
+		}
+	});
+
+	// turn the per-worker vertex indices into indices into the joined vertex list
+	std::vector<int> vertexOffset(workers, 0);
+	for (int w = 1; w < workers; w++) {
+		vertexOffset[w] = vertexOffset[w - 1] + (int)(slabVertices[w - 1].size() / 3);
+	}
+	parallel_for(0, cells[0], [&](int begin, int end, int worker) {
+		for (size_t c = cellIndex(begin, 0, 0); c < cellIndex(end, 0, 0); c++) {
+			if (cellVertex[c] != -1) {
+				cellVertex[c] += vertexOffset[worker];
+			}
+		}
+	});
+
+	// second pass: every lattice edge crossed by the surface is shared by 4 cells, join their vertices with a quad
+	std::vector<std::vector<unsigned int>> slabIndices(workers);
+
+	parallel_for(0, grid.dims[0], [&](int begin, int end, int worker) {
+		std::vector<unsigned int>& indices = slabIndices[worker];
+
+		for (int i = begin; i < end; i++) {
+			for (int j = 0; j < grid.dims[1]; j++) {
+				for (int k = 0; k < grid.dims[2]; k++) {
+					int p[3] = { i, j, k };
+					bool inside = grid.values[grid.index(i, j, k)] < isoValue;
+
+					// the edge leaving this lattice point along each axis
+					for (int a = 0; a < 3; a++) {
+						int b = (a + 1) % 3;
+						int c = (a + 2) % 3;
+
+						// the edge and all 4 cells around it must lie inside the grid
+						if (p[a] >= cells[a] || p[b] < 1 || p[b] >= cells[b] || p[c] < 1 || p[c] >= cells[c]) {
+							continue;
+						}
+
+						int q[3] = { i, j, k };
+						q[a]++;
+						if (inside == (grid.values[grid.index(q[0], q[1], q[2])] < isoValue)) {
+							continue;
+						}
+
+						// the 4 cells sharing the edge, in order around it
+						int quad[4];
+						int offsets[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+						for (int v = 0; v < 4; v++) {
+							int cell[3] = { i, j, k };
+							cell[b] -= offsets[v][0];
+							cell[c] -= offsets[v][1];
+							quad[v] = cellVertex[cellIndex(cell[0], cell[1], cell[2])];
+						}
+
+						// wind the quad so that it faces the same way as the marching cubes triangles
+						if (inside) {
+							indices.insert(indices.end(), { (unsigned int)quad[0], (unsigned int)quad[1], (unsigned int)quad[2] });
+							indices.insert(indices.end(), { (unsigned int)quad[0], (unsigned int)quad[2], (unsigned int)quad[3] });
+						}
+						else {
+							indices.insert(indices.end(), { (unsigned int)quad[0], (unsigned int)quad[2], (unsigned int)quad[1] });
+							indices.insert(indices.end(), { (unsigned int)quad[0], (unsigned int)quad[3], (unsigned int)quad[2] });
+						}
+					}
+				}
+			}
+		}
+	});
+
+	// join the per-worker lists into the returned mesh
+	Mesh mesh;
+	for (const std::vector<float>& vertices : slabVertices) {
+		mesh.vertices.insert(mesh.vertices.end(), vertices.begin(), vertices.end());
+	}
+	for (const std::vector<unsigned int>& indices : slabIndices) {
+		mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+	}
+	return mesh;
+}
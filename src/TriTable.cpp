@@ -273,4 +273,32 @@ float vertTable[12][3] = {
 	{1.0f, 0.5f, 0.0f},
 	{1.0f, 0.5f, 1.0f},
 	{0.0f, 0.5f, 1.0f},
+};
+
+// lattice offsets of the 8 cube corners, matching the corner layout used by vertTable
+int cornerTable[8][3] = {
+	{0, 0, 0},
+	{1, 0, 0},
+	{1, 0, 1},
+	{0, 0, 1},
+	{0, 1, 0},
+	{1, 1, 0},
+	{1, 1, 1},
+	{0, 1, 1},
+};
+
+// the two corners joined by each of the 12 cube edges
+int edgeCorners[12][2] = {
+	{0, 1},
+	{1, 2},
+	{2, 3},
+	{3, 0},
+	{4, 5},
+	{5, 6},
+	{6, 7},
+	{7, 4},
+	{0, 4},
+	{1, 5},
+	{2, 6},
+	{3, 7},
 };
\ No newline at end of file